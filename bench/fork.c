@@ -0,0 +1,64 @@
+// for clock_gettime
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "atari.h"
+
+// forks a second a tree search gets out of the library, for each format of
+// observation, from a console a few steps into its rom. links the library
+// the way a c program does. usage : fork [rom [seconds]]
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// forks of console 0 into the others in turn, a batch at a time between
+// looks at the clock
+static void run(atari_envs* envs, unsigned count, double seconds,
+                const char* name) {
+    double t0 = now();
+    double dt;
+    unsigned long forks = 0;
+    do {
+        for (unsigned i = 0; i < 100000; i++) {
+            atari_fork(envs, 0, 1 + i % (count - 1));
+        }
+        forks += 100000;
+        dt = now() - t0;
+    } while (dt < seconds);
+    printf("%-9s : %.2f M forks/s, %.0f ns per fork\n", name,
+           forks / dt / 1e6, dt * 1e9 / forks);
+}
+
+int main(int argc, char** argv) {
+    const char* rom = (argc > 1) ? argv[1] : "test/kernel.rom";
+    double seconds = (argc > 2) ? atof(argv[2]) : 1;
+    uint8_t actions[16] = {0};
+    const unsigned count = sizeof(actions);
+
+    atari_envs* envs = atari_create(rom, count, 1);
+    if (envs == NULL) {
+        printf("could not load %s\n", rom);
+        return 1;
+    }
+    printf("state %zu bytes\n", atari_get_state_size(envs));
+
+    const int formats[] = {ATARI_INDICES, ATARI_GRAYSCALE};
+    const char* const names[] = {"indices", "grayscale"};
+    for (unsigned f = 0; f < 2; f++) {
+        atari_set_observation(envs, formats[f], 84, 84);
+        uint8_t* obs = malloc(count * atari_get_observation_size(envs));
+        for (unsigned i = 0; i < 10; i++) {
+            atari_step(envs, actions, obs);
+        }
+        run(envs, count, seconds, names[f]);
+        free(obs);
+    }
+    atari_destroy(envs);
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "gfx.hpp"
+
+// the cost of a tia clock on a shown line with all six objects drawing, the
+// path every visible pixel takes. only the tia is clocked, the cpu never
+// runs. usage : pixel [clocks]
+int main(int argc, char** argv) {
+    unsigned long clocks = 50000000;
+    if (argc > 1) {
+        clocks = std::strtoul(argv[1], nullptr, 0);
+    }
+    gfx::init();
+
+    // a playfield, the ball, both players and both missiles, all enabled and
+    // spread over the line, each in a colour of its own
+    const char regs[][2] = {
+        {0x06, 0x1e}, {0x07, 0x44}, {0x08, 0x86}, {0x09, 0x02},
+        {0x0d, 0xa0}, {0x0e, 0x55}, {0x0f, 0xaa},
+        {0x1b, 0xc3}, {0x1c, 0x5a}, {0x1d, 0x02}, {0x1e, 0x02},
+        {0x1f, 0x02}, {0x04, 0x10}, {0x05, 0x07},
+    };
+    for (auto& r : regs) {
+        gfx::set(r[0], r[1]);
+    }
+
+    // down to the shown lines, placing an object every few clocks
+    const char resets[] = {0x10, 0x11, 0x12, 0x13, 0x14};
+    for (unsigned i = 0; i < 50 * 228; i++) {
+        if (i % 228 == 90 + 20 * (i / 228 % 5)) {
+            gfx::set(resets[i / 228 % 5], 0);
+        }
+        gfx::cycle();
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < clocks; i++) {
+        gfx::cycle();
+    }
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+
+    // the line has 68 clocks of blanking against 160 pixels
+    std::printf("%lu clocks in %.3f s : %.2f ns per clock, %.2f ns per "
+                "pixel\n", clocks, dt.count(), dt.count() * 1e9 / clocks,
+                dt.count() * 1e9 / clocks * 228 / 160);
+    return 0;
+}
@@ -0,0 +1,489 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+
+#include "atari.h"
+#include "console.hpp"
+#include "frame.hpp"
+#include "input.hpp"
+#include "machine.hpp"
+#include "rom.hpp"
+#include "palette.hpp"
+#include "observation.hpp"
+#include "memo.hpp"
+
+static_assert(ATARI_OBSERVATION_SIZE == sizeof(frame::t_buffer),
+              "an observation is a frame");
+static_assert(ATARI_RAM_SIZE == machine::ram_size, "the ram of the riot");
+static_assert(ATARI_RIGHT == 1 << input::key_right &&
+              ATARI_LEFT == 1 << input::key_left &&
+              ATARI_DOWN == 1 << input::key_down &&
+              ATARI_UP == 1 << input::key_up &&
+              ATARI_FIRE == 1 << input::key_left_trigger &&
+              ATARI_FIRE2 == 1 << input::key_right_trigger,
+              "actions are masks of keys");
+
+// the consoles are kept saved and only loaded into a thread to be stepped,
+// so any thread can step any of them. they all play the one mapped rom.
+// workers sleep between steps
+struct atari_envs {
+    t_rom rom;
+    unsigned count;
+    std::size_t state_size;
+    std::vector<char> states;
+    std::vector<long> frames;
+    std::vector<std::uint64_t> hashes;
+    unsigned repeat;
+    bool max_pool;
+    bool video;
+
+    // grayscale is made from frames of each console's own, which a fork
+    // shares with its parent until one of them draws. which are shared is
+    // settled before a step, for the batch to copy them
+    int format;
+    observation::t_grayscale grayscale;
+    std::vector<std::shared_ptr<frame::t_buffer>> screens;
+    std::vector<char> shared;
+
+    // steps already taken, by the state and the action they were taken from
+    t_memo memo;
+
+    // the step in progress, handed out one console at a time
+    const std::uint8_t* actions;
+    std::uint8_t* observations;
+    std::atomic<unsigned> next;
+    std::atomic<unsigned> failed;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned long generation;
+    unsigned busy;
+    bool quitting;
+    std::vector<std::thread> workers;
+};
+
+namespace {
+    // the frame before the last of a step, to pool with the last
+    thread_local frame::t_buffer pool_buffer;
+
+    // a step in the memo : what it added to the counters and the hash it
+    // ended at, then the state it ended in, then its frame when there is
+    // video, then its observation when that is not the frame. it is put
+    // together and taken apart here
+    struct t_memo_head {
+        console::t_counters added;
+        std::uint64_t hash;
+    };
+    const std::size_t memo_buffer_size = 0x1000 + 2 * sizeof(frame::t_buffer);
+    thread_local std::array<char, memo_buffer_size> memo_buffer;
+
+    char* get_state(atari_envs* envs, unsigned index) {
+        return envs->states.data() + index * envs->state_size;
+    }
+
+    const char* get_state(const atari_envs* envs, unsigned index) {
+        return envs->states.data() + index * envs->state_size;
+    }
+
+    std::size_t get_memo_size(const atari_envs* envs) {
+        auto size = sizeof(t_memo_head) + envs->state_size;
+        if (envs->video) {
+            size += sizeof(frame::t_buffer);
+            if (envs->format == ATARI_GRAYSCALE) {
+                size += envs->grayscale.get_size();
+            }
+        }
+        return size;
+    }
+
+    // the console loaded is moved on to where the step ended, with its
+    // counters going on from its own
+    bool recall(atari_envs* envs, unsigned index, std::uint64_t key,
+                std::uint8_t* obs, frame::t_buffer* screen) {
+        auto size = get_memo_size(envs);
+        if (envs->memo.find(key, memo_buffer.data(), size) == false) {
+            return false;
+        }
+        t_memo_head head;
+        std::memcpy(&head, memo_buffer.data(), sizeof(head));
+        auto p = memo_buffer.data() + sizeof(head);
+
+        auto counters = console::get_counters();
+        console::load_state(p);
+        console::set_counters({
+            counters.frames + head.added.frames,
+            counters.steps + head.added.steps,
+            counters.bad_opcodes + head.added.bad_opcodes,
+        });
+        console::save_state(get_state(envs, index));
+        envs->frames[index] = frame::get_count();
+        envs->hashes[index] = head.hash;
+        p += envs->state_size;
+
+        if (envs->video) {
+            std::memcpy(screen->data(), p, screen->size());
+            p += screen->size();
+            if (envs->format == ATARI_GRAYSCALE) {
+                std::memcpy(obs, p, envs->grayscale.get_size());
+            }
+        }
+        return true;
+    }
+
+    void remember(atari_envs* envs, unsigned index, std::uint64_t key,
+                  const console::t_counters& start, const std::uint8_t* obs,
+                  const frame::t_buffer* screen) {
+        auto end = console::get_counters();
+        t_memo_head head = {
+            {
+                end.frames - start.frames,
+                end.steps - start.steps,
+                end.bad_opcodes - start.bad_opcodes,
+            },
+            envs->hashes[index],
+        };
+        std::memcpy(memo_buffer.data(), &head, sizeof(head));
+        auto p = memo_buffer.data() + sizeof(head);
+        std::memcpy(p, get_state(envs, index), envs->state_size);
+        p += envs->state_size;
+
+        if (envs->video) {
+            std::memcpy(p, screen->data(), screen->size());
+            p += screen->size();
+            if (envs->format == ATARI_GRAYSCALE) {
+                std::memcpy(p, obs, envs->grayscale.get_size());
+            }
+        }
+        envs->memo.add(key, memo_buffer.data(), get_memo_size(envs));
+    }
+
+    // a screen still shared with a fork is copied before it is drawn into.
+    // the consoles sharing it all copy it then, as none of them may write
+    // to it while the others read it
+    frame::t_buffer* own_screen(atari_envs* envs, unsigned index) {
+        auto& screen = envs->screens[index];
+        if (envs->shared[index]) {
+            screen = std::make_shared<frame::t_buffer>(*screen);
+        }
+        return screen.get();
+    }
+
+    // frames in between are run without drawing, and all of them with video
+    // off, when there may be no observations to draw into. with the memo on,
+    // a step it has seen is copied from it instead. only steps whose frames
+    // drew every pixel go in, as the frames of the others still show some
+    // of what came before
+    void step_one(atari_envs* envs, unsigned index) {
+        auto gray = (envs->format == ATARI_GRAYSCALE);
+        auto pooling = envs->video && envs->max_pool && envs->repeat > 1;
+        std::uint8_t* obs = nullptr;
+        frame::t_buffer* screen = nullptr;
+        if (envs->video) {
+            obs = envs->observations + index * atari_get_observation_size(envs);
+            screen = gray ? own_screen(envs, index) :
+                reinterpret_cast<frame::t_buffer*>(obs);
+        }
+
+        console::set_rom(envs->rom);
+        console::load_state(get_state(envs, index));
+        machine::clear_ram_changes();
+        input::hold(envs->actions[index]);
+
+        // the action is in the hash, through the input latches
+        auto memo = (envs->memo.get_budget() != 0);
+        std::uint64_t key = 0;
+        auto start = console::get_counters();
+        if (memo) {
+            key = console::hash_state();
+            if (recall(envs, index, key, obs, screen)) {
+                return;
+            }
+        }
+
+        if (pooling) {
+            pool_buffer = *screen;
+        }
+        auto whole = true;
+        auto ok = true;
+        for (unsigned i = envs->repeat; i != 0; i--) {
+            frame::set_target((i == 1) ? screen : &pool_buffer);
+            frame::set_skipping(envs->video == false || i > 2 ||
+                                (i == 2 && pooling == false));
+            if (console::run_frame() == false) {
+                envs->failed++;
+                ok = false;
+                break;
+            }
+            if (frame::is_skipping() == false && frame::is_whole() == false) {
+                whole = false;
+            }
+        }
+        if (envs->video && gray) {
+            envs->grayscale.run(*screen, pooling ? &pool_buffer : nullptr, obs);
+        } else if (pooling) {
+            observation::max_pool(pool_buffer, *screen);
+        }
+        frame::set_target(nullptr);
+        frame::set_skipping(false);
+        envs->frames[index] = frame::get_count();
+        envs->hashes[index] = console::hash_state();
+        console::save_state(get_state(envs, index));
+        if (memo && ok && whole) {
+            remember(envs, index, key, start, obs, screen);
+        }
+    }
+
+    void run_batch(atari_envs* envs) {
+        unsigned i;
+        while ((i = envs->next++) < envs->count) {
+            step_one(envs, i);
+        }
+    }
+
+    void work(atari_envs* envs) {
+        unsigned long generation = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(envs->lock);
+                envs->wake.wait(lock, [&] {
+                    return envs->quitting || envs->generation != generation;
+                });
+                if (envs->quitting) {
+                    return;
+                }
+                generation = envs->generation;
+            }
+            run_batch(envs);
+            std::lock_guard<std::mutex> lock(envs->lock);
+            if (--envs->busy == 0) {
+                envs->done.notify_one();
+            }
+        }
+    }
+
+    // the palette and the observation tables are shared by all batches and
+    // never change after, so they are made once, by whichever call comes
+    // first
+    void init_tables() {
+        static auto tables = [] {
+            palette::init();
+            observation::init();
+            return true;
+        }();
+        (void)tables;
+    }
+}
+
+atari_envs* atari_create(const char* rom, unsigned count, unsigned threads) {
+    auto envs = new atari_envs;
+    if (envs->rom.load(rom) == false) {
+        delete envs;
+        return nullptr;
+    }
+    envs->count = count;
+    envs->repeat = 1;
+    envs->max_pool = false;
+    envs->video = true;
+    envs->format = ATARI_INDICES;
+    envs->state_size = console::get_state_size();
+    envs->states.resize(count * envs->state_size);
+    envs->frames.resize(count);
+    envs->hashes.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        atari_reset(envs, i);
+    }
+
+    init_tables();
+
+    envs->generation = 0;
+    envs->busy = 0;
+    envs->quitting = false;
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threads = std::max(std::min(threads, count), 1u);
+    for (unsigned i = 1; i < threads; i++) {
+        envs->workers.emplace_back(work, envs);
+    }
+    return envs;
+}
+
+void atari_destroy(atari_envs* envs) {
+    if (envs == nullptr) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(envs->lock);
+        envs->quitting = true;
+    }
+    envs->wake.notify_all();
+    for (auto& t : envs->workers) {
+        t.join();
+    }
+    delete envs;
+}
+
+unsigned atari_get_count(const atari_envs* envs) {
+    return envs->count;
+}
+
+size_t atari_get_state_size(const atari_envs* envs) {
+    return envs->state_size;
+}
+
+void atari_set_repeat(atari_envs* envs, unsigned repeat, int max_pool) {
+    envs->repeat = std::max(repeat, 1u);
+    envs->max_pool = (max_pool != 0);
+    envs->memo.clear();
+}
+
+void atari_set_video(atari_envs* envs, int video) {
+    envs->video = (video != 0);
+    envs->memo.clear();
+}
+
+int atari_set_observation(atari_envs* envs, int format, unsigned width,
+                          unsigned height) {
+    if (format == ATARI_GRAYSCALE) {
+        if (envs->grayscale.init(width, height) == false) {
+            return -1;
+        }
+        envs->screens.resize(envs->count);
+        for (auto& screen : envs->screens) {
+            if (screen == nullptr) {
+                screen = std::make_shared<frame::t_buffer>();
+            }
+        }
+        envs->shared.resize(envs->count);
+    } else if (format == ATARI_INDICES) {
+        envs->screens.clear();
+        envs->shared.clear();
+    } else {
+        return -1;
+    }
+    envs->format = format;
+    envs->memo.clear();
+    return 0;
+}
+
+size_t atari_get_observation_size(const atari_envs* envs) {
+    if (envs->format == ATARI_GRAYSCALE) {
+        return envs->grayscale.get_size();
+    }
+    return ATARI_OBSERVATION_SIZE;
+}
+
+// runs on the calling thread, whose own console is lost to it
+void atari_reset(atari_envs* envs, unsigned index) {
+    console::init(envs->rom);
+    console::save_state(get_state(envs, index));
+    envs->frames[index] = 0;
+    envs->hashes[index] = console::hash_state();
+    if (envs->screens.empty() == false) {
+        envs->screens[index] = std::make_shared<frame::t_buffer>();
+    }
+}
+
+// the caller works through the batch as well, and then waits for the
+// consoles the workers are still on. the screens forks share are told
+// apart first, while nothing else holds on to them
+unsigned atari_step(atari_envs* envs, const uint8_t* actions,
+                    uint8_t* observations) {
+    for (std::size_t i = 0; i < envs->shared.size(); i++) {
+        envs->shared[i] = (envs->screens[i].use_count() > 1);
+    }
+    envs->actions = actions;
+    envs->observations = observations;
+    envs->next = 0;
+    envs->failed = 0;
+    {
+        std::lock_guard<std::mutex> lock(envs->lock);
+        envs->busy = envs->workers.size();
+        envs->generation++;
+    }
+    envs->wake.notify_all();
+    run_batch(envs);
+
+    std::unique_lock<std::mutex> lock(envs->lock);
+    envs->done.wait(lock, [&] { return envs->busy == 0; });
+    return envs->failed;
+}
+
+// straight from the saved consoles
+const uint8_t* atari_get_ram(const atari_envs* envs, unsigned index) {
+    auto ram = console::get_saved_ram(get_state(envs, index));
+    return reinterpret_cast<const std::uint8_t*>(ram);
+}
+
+const uint8_t* atari_get_ram_changes(const atari_envs* envs, unsigned index) {
+    return console::get_saved_ram_changes(get_state(envs, index));
+}
+
+long atari_get_frame(const atari_envs* envs, unsigned index) {
+    return envs->frames[index];
+}
+
+uint64_t atari_get_state_hash(const atari_envs* envs, unsigned index) {
+    return envs->hashes[index];
+}
+
+// a grayscale console keeps its frame outside of its state, which goes
+// along, as a child drawing less than a whole frame would show what its
+// slot held before. it is shared rather than copied, until one of them
+// steps. an indices console draws into the caller's observations, which
+// are left alone
+void atari_fork(atari_envs* envs, unsigned parent, unsigned child) {
+    if (parent == child) {
+        return;
+    }
+    std::memcpy(get_state(envs, child), get_state(envs, parent),
+                envs->state_size);
+    envs->frames[child] = envs->frames[parent];
+    envs->hashes[child] = envs->hashes[parent];
+    if (envs->screens.empty() == false) {
+        envs->screens[child] = envs->screens[parent];
+    }
+}
+
+void atari_save_state(const atari_envs* envs, unsigned index, void* state) {
+    std::memcpy(state, get_state(envs, index), envs->state_size);
+}
+
+// the frame count and the hash are taken from the console loaded, as the
+// state is opaque to the batch
+void atari_load_state(atari_envs* envs, unsigned index, const void* state) {
+    std::memcpy(get_state(envs, index), state, envs->state_size);
+    console::set_rom(envs->rom);
+    console::load_state(get_state(envs, index));
+    envs->frames[index] = frame::get_count();
+    envs->hashes[index] = console::hash_state();
+}
+
+int atari_set_memo(atari_envs* envs, size_t budget) {
+    if (get_memo_size(envs) > memo_buffer_size) {
+        return -1;
+    }
+    envs->memo.set_budget(budget);
+    return 0;
+}
+
+void atari_get_memo_stats(const atari_envs* envs, atari_memo_stats* stats) {
+    auto val = envs->memo.get_stats();
+    stats->hits = val.hits;
+    stats->misses = val.misses;
+    stats->evictions = val.evictions;
+    stats->entries = val.entries;
+    stats->bytes = val.used;
+}
+
+void atari_get_palette(uint32_t* argb) {
+    init_tables();
+    auto table = palette::get_argb();
+    std::copy(table, table + palette::argb_size, argb);
+}
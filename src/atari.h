@@ -0,0 +1,147 @@
+#pragma once
+
+// the c interface of libatari : a batch of consoles running the same rom,
+// stepped together on a pool of threads. link the static libatari.a, which
+// a c program does with a c++ compiler, or -lstdc++ -lm -pthread.
+// the core keeps the console a thread runs in thread local variables,
+// which a shared library reaches through a call in every function that
+// touches them, dozens of times for each cpu cycle. make shared builds a
+// libatari.so for clients that can only load one, but it steps at half the
+// speed of the archive, 170 against 350 steps a second of one console on
+// kernel.rom. passing the console to the core would close that gap
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a frame, and by default an observation, is one palette index per pixel,
+// row by row
+#define ATARI_WIDTH 160
+#define ATARI_HEIGHT 192
+#define ATARI_OBSERVATION_SIZE (ATARI_WIDTH * ATARI_HEIGHT)
+
+// the ram of a console, and a bit for each byte of it
+#define ATARI_RAM_SIZE 128
+#define ATARI_RAM_CHANGES_SIZE (ATARI_RAM_SIZE / 8)
+
+// the formats of an observation
+enum {
+    ATARI_INDICES,
+    ATARI_GRAYSCALE,
+};
+
+// the bits of an action, the controls held for a step
+enum {
+    ATARI_RIGHT = 0x01,
+    ATARI_LEFT = 0x02,
+    ATARI_DOWN = 0x04,
+    ATARI_UP = 0x08,
+    ATARI_FIRE = 0x10,
+    ATARI_FIRE2 = 0x20,
+};
+
+typedef struct atari_envs atari_envs;
+
+// count consoles, all reset, stepped on up to threads threads including the
+// caller's. 0 threads is one per core. null if the rom can not be read
+atari_envs* atari_create(const char* rom, unsigned count, unsigned threads);
+void atari_destroy(atari_envs* envs);
+unsigned atari_get_count(const atari_envs* envs);
+size_t atari_get_state_size(const atari_envs* envs);
+
+// one console back to power on
+void atari_reset(atari_envs* envs, unsigned index);
+
+// a step holds its action for repeat frames, 1 by default, and only the
+// last frame is drawn. with max_pool set the one before it is drawn too,
+// and the observation keeps the brighter of the two at each pixel
+void atari_set_repeat(atari_envs* envs, unsigned repeat, int max_pool);
+
+// with video off no frame is drawn, nor any observation written, and
+// observations may be null. the consoles run and collide the same way, for
+// those that only look at their memory. on by default
+void atari_set_video(atari_envs* envs, int video);
+
+// grayscale observations are one luminance byte per pixel, area resampled
+// to width by height, 84 by 84 being the usual. the size is ignored for
+// indices. -1 for a size larger than a frame
+int atari_set_observation(atari_envs* envs, int format, unsigned width,
+                          unsigned height);
+size_t atari_get_observation_size(const atari_envs* envs);
+
+// runs every console for a step with one action byte each, and writes the
+// observations to their places in observations, count times the
+// observation size. indices are drawn straight into their place, over what
+// it held before. returns the number of consoles that did not finish their
+// frames
+unsigned atari_step(atari_envs* envs, const uint8_t* actions,
+                    uint8_t* observations);
+
+// the ram of a console as its last step or reset left it, read in place.
+// valid until the next step or reset of the batch
+const uint8_t* atari_get_ram(const atari_envs* envs, unsigned index);
+
+// the bytes of ram the last step changed, byte i in bit i % 8 of byte
+// i / 8. a byte changed and changed back still counts. all clear after a
+// reset
+const uint8_t* atari_get_ram_changes(const atari_envs* envs, unsigned index);
+
+// frames a console has finished since its reset
+long atari_get_frame(const atari_envs* envs, unsigned index);
+
+// a hash of all that decides how a console goes on, but not of its frame
+// count, so consoles that meet in one state share it, for a search to merge
+// them. taken as the last step, reset or load left the console, at no cost
+// to read. the same as the state column of a --hash file
+uint64_t atari_get_state_hash(const atari_envs* envs, unsigned index);
+
+// the console at child becomes a copy of the one at parent, and goes on
+// from there on whichever thread steps it next, for a tree search to
+// branch with. not while stepping.
+// it copies the state size, about 12 ns. a grayscale console keeps its 30K
+// frame besides, which the child shares with the parent until one of them
+// steps, and is only copied then. bench/fork measures both.
+// with indices the frame is the observation itself, in the caller's
+// buffer, which is not copied : the child's slot keeps what it held, and a
+// child whose next frame draws less than the whole screen shows the rest
+// of that, and not the parent's frame. copy the parent's observation over
+// first where that matters
+void atari_fork(atari_envs* envs, unsigned parent, unsigned child);
+
+// a console to and from memory of the caller's, of the state size, for
+// nodes kept outside of the batch. loading takes over the calling thread's
+// own console, like a reset
+void atari_save_state(const atari_envs* envs, unsigned index, void* state);
+void atari_load_state(atari_envs* envs, unsigned index, const void* state);
+
+// an optional memo of steps, for games that keep coming back to one state,
+// like attract modes, title screens and pauses. a step taken again from a
+// state and with an action the memo holds is copied from it, state, frame
+// and observation, at the cost of a few copies rather than a few frames.
+// states are told apart by their hash alone. only steps whose frames are
+// drawn whole go in, and the memo is cleared whenever the way of stepping
+// changes. it keeps to budget bytes, forgetting the steps used longest ago
+// first. 0 turns it off, which it is by default. -1 if a step would not
+// fit. not while stepping
+int atari_set_memo(atari_envs* envs, size_t budget);
+
+typedef struct atari_memo_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t bytes;
+} atari_memo_stats;
+
+// counted since the batch was created, over all of its consoles
+void atari_get_memo_stats(const atari_envs* envs, atari_memo_stats* stats);
+
+// the colours of the palette indices, as 0xaarrggbb
+void atari_get_palette(uint32_t* argb);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,354 @@
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+
+#include "misc.hpp"
+#include "audio.hpp"
+#include "ring.hpp"
+
+// the tia makes two samples per scanline
+const auto tia_sample_rate = 3579545.0 / 114;
+
+// how far the resampling ratio may be bent to steer the ring fill level
+const auto max_rate_adjust = 0.005;
+
+// taps and phases of the interpolation filter of the resampler
+const auto filter_taps = 16u;
+const auto filter_phases = 64u;
+
+// one of the two tia sound generators: a 5-bit frequency divider clocking
+// a 4-bit pulse counter and a 5-bit noise counter, whose feedback taps are
+// picked by AUDC
+class t_channel {
+    char audc;
+    char audf;
+    char audv;
+    char div_cnt;
+    char pulse_cnt;
+    char noise_cnt;
+    bool clock_enable;
+    bool noise_feedback;
+    bool noise_cnt_bit4;
+    bool pulse_cnt_hold;
+
+public:
+    void init() {
+        audc = 0;
+        audf = 0;
+        audv = 0;
+        div_cnt = 0;
+        pulse_cnt = 0;
+        noise_cnt = 0;
+        clock_enable = false;
+        noise_feedback = false;
+        noise_cnt_bit4 = false;
+        pulse_cnt_hold = false;
+    }
+
+    void set_control(char val) {
+        audc = val & 0x0f;
+    }
+
+    void set_frequency(char val) {
+        audf = val & 0x1f;
+    }
+
+    void set_volume(char val) {
+        audv = val & 0x0f;
+    }
+
+    void phase0() {
+        if (clock_enable) {
+            noise_cnt_bit4 = noise_cnt & 0x01;
+
+            switch (audc & 0x03) {
+            case 0x00: case 0x01:
+                pulse_cnt_hold = false;
+                break;
+            case 0x02:
+                pulse_cnt_hold = (noise_cnt & 0x1e) != 0x02;
+                break;
+            case 0x03:
+                pulse_cnt_hold = !noise_cnt_bit4;
+                break;
+            }
+
+            if ((audc & 0x03) == 0) {
+                noise_feedback = ((pulse_cnt ^ noise_cnt) & 0x01) ||
+                    !(noise_cnt || pulse_cnt != 0x0a) || !(audc & 0x0c);
+            } else {
+                noise_feedback = (((noise_cnt >> 2) ^ noise_cnt) & 0x01) ||
+                    noise_cnt == 0;
+            }
+        }
+
+        clock_enable = (div_cnt == audf);
+        if (div_cnt == audf || div_cnt == 0x1f) {
+            div_cnt = 0;
+        } else {
+            div_cnt++;
+        }
+    }
+
+    char phase1() {
+        if (clock_enable) {
+            bool pulse_feedback = false;
+            switch (audc >> 2) {
+            case 0x00:
+                pulse_feedback = (((pulse_cnt >> 1) ^ pulse_cnt) & 0x01) &&
+                    pulse_cnt != 0x0a && (audc & 0x03);
+                break;
+            case 0x01:
+                pulse_feedback = !(pulse_cnt & 0x08);
+                break;
+            case 0x02:
+                pulse_feedback = !noise_cnt_bit4;
+                break;
+            case 0x03:
+                pulse_feedback = !((pulse_cnt & 0x02) || !(pulse_cnt & 0x0e));
+                break;
+            }
+
+            noise_cnt >>= 1;
+            if (noise_feedback) {
+                noise_cnt |= 0x10;
+            }
+            if (pulse_cnt_hold == false) {
+                pulse_cnt = ~(pulse_cnt >> 1) & 0x07;
+                if (pulse_feedback) {
+                    pulse_cnt |= 0x08;
+                }
+            }
+        }
+        return (pulse_cnt & 0x01) * audv;
+    }
+
+    std::uint64_t hash(std::uint64_t h) {
+        h = hash_word(h, audc | audf << 8 | audv << 16 |
+                      unsigned(div_cnt) << 24 |
+                      std::uint64_t(std::uint8_t(pulse_cnt)) << 32 |
+                      std::uint64_t(std::uint8_t(noise_cnt)) << 40);
+        return hash_word(h, clock_enable | noise_feedback << 8 |
+                         noise_cnt_bit4 << 16 | pulse_cnt_hold << 24);
+    }
+};
+
+namespace {
+    thread_local t_channel channel[2];
+
+    template <typename t_archive>
+    void transfer(t_archive& ar) {
+        ar(channel);
+    }
+
+    // samples from the emulation thread to the audio callback, 0 to 30.
+    // unlike the channels, these are shared by all threads
+    t_ring<char, 0x2000> samples;
+    std::atomic<bool> enabled;
+    std::atomic<unsigned long> underrun_cnt;
+    std::atomic<unsigned long> overrun_cnt;
+    std::atomic<unsigned> latency(30);
+
+    // resampler state, only touched by the audio callback once enabled
+    std::array<std::array<float, filter_taps>, filter_phases> filter;
+    std::array<float, filter_taps> history;
+    double position;
+    double step;
+    // what one callback takes out of the ring at once, in tia samples
+    double block_fill;
+    double average_fill;
+    double drift;
+    char last_sample;
+    float dc_in;
+    float dc_out;
+
+    // a windowed sinc low pass at the lower of the two nyquist frequencies,
+    // one row of taps per fractional position between two input samples
+    void init_filter(double cutoff) {
+        const auto pi = 3.14159265358979323846;
+        for (unsigned p = 0; p < filter_phases; p++) {
+            auto frac = double(p) / filter_phases;
+            double sum = 0;
+            for (unsigned k = 0; k < filter_taps; k++) {
+                auto t = double(k) - (filter_taps / 2 - 1) - frac;
+                auto x = pi * cutoff * t;
+                auto sinc = (t == 0) ? 1.0 : std::sin(x) / x;
+                auto w = t / (filter_taps / 2);
+                auto window = (std::abs(w) >= 1) ? 0.0 : std::cos(w * pi / 2);
+                filter[p][k] = float(sinc * window * window);
+                sum += filter[p][k];
+            }
+            for (auto& f : filter[p]) {
+                f = float(f / sum);
+            }
+        }
+    }
+
+    // the emulation is paced by the wall clock, which drifts against the
+    // sound card. keep the ring around half of the latency bound by slightly
+    // stretching or squeezing the resampling ratio, with the drift itself
+    // learned by the integral term, and drop samples if it is over the bound
+    // anyway. a bound the ring can not hold, less a callback's worth, is
+    // cut down to what it can, which is about a quarter of a second
+    double get_adjusted_step() {
+        auto max_fill = std::min(latency * tia_sample_rate / 1000,
+                                 samples.get_size() - block_fill);
+        auto target = max_fill / 2;
+
+        double fill = samples.get_count();
+        if (fill > max_fill) {
+            char val;
+            while (fill > target && samples.pop(val)) {
+                overrun_cnt++;
+                fill--;
+            }
+            average_fill = fill;
+        }
+        average_fill += 0.05 * (fill - average_fill);
+
+        auto error = (average_fill - target) / target;
+        drift += error * max_rate_adjust * 0.01;
+        drift = std::max(-max_rate_adjust, std::min(max_rate_adjust, drift));
+        auto adjust = drift + error * max_rate_adjust;
+        adjust = std::max(-max_rate_adjust, std::min(max_rate_adjust, adjust));
+        return step * (1 + adjust);
+    }
+
+    void pull_sample() {
+        char val;
+        if (samples.pop(val)) {
+            last_sample = val;
+        } else {
+            underrun_cnt++;
+        }
+        std::copy(history.begin() + 1, history.end(), history.begin());
+        history.back() = last_sample / 30.0f;
+    }
+}
+
+void audio::init() {
+    channel[0].init();
+    channel[1].init();
+}
+
+void audio::set(char addr, char val) {
+    switch (addr) {
+
+    case 0x15:
+        channel[0].set_control(val);
+        break;
+
+    case 0x16:
+        channel[1].set_control(val);
+        break;
+
+    case 0x17:
+        channel[0].set_frequency(val);
+        break;
+
+    case 0x18:
+        channel[1].set_frequency(val);
+        break;
+
+    case 0x19:
+        channel[0].set_volume(val);
+        break;
+
+    case 0x1a:
+        channel[1].set_volume(val);
+        break;
+
+    }
+}
+
+void audio::phase0() {
+    channel[0].phase0();
+    channel[1].phase0();
+}
+
+void audio::phase1() {
+    char val = channel[0].phase1() + channel[1].phase1();
+    if (enabled.load(std::memory_order_relaxed)) {
+        if (samples.push(val) == false) {
+            overrun_cnt++;
+        }
+    }
+}
+
+std::uint64_t audio::hash_state(std::uint64_t h) {
+    h = channel[0].hash(h);
+    return channel[1].hash(h);
+}
+
+std::size_t audio::get_state_size() {
+    t_state_size ar;
+    transfer(ar);
+    return ar.get();
+}
+
+char* audio::save_state(char* out) {
+    t_state_saver ar(out);
+    transfer(ar);
+    return ar.get();
+}
+
+const char* audio::load_state(const char* in) {
+    t_state_loader ar(in);
+    transfer(ar);
+    return ar.get();
+}
+
+// has to be called before the audio callback starts running, with the
+// samples it asks for at once
+void audio::set_output_rate(unsigned rate, unsigned block) {
+    step = tia_sample_rate / rate;
+    block_fill = std::ceil(block * step) + 1;
+    init_filter(std::min(1.0, rate / tia_sample_rate) * 0.9);
+    std::fill(history.begin(), history.end(), 0.0f);
+    position = 0;
+    average_fill = 0;
+    drift = 0;
+    last_sample = 0;
+    dc_in = 0;
+    dc_out = 0;
+    enabled = true;
+}
+
+// the bound on the samples waiting for the sound card. the ring holds about
+// 260 ms of them, and a longer bound is cut down to that, less a callback
+void audio::set_latency(unsigned ms) {
+    latency = std::max(ms, 1u);
+}
+
+void audio::mix(std::int16_t* out, unsigned count) {
+    auto cur_step = get_adjusted_step();
+    for (unsigned i = 0; i < count; i++) {
+        while (position >= 1) {
+            pull_sample();
+            position -= 1;
+        }
+
+        auto& taps = filter[unsigned(position * filter_phases)];
+        float val = 0;
+        for (unsigned k = 0; k < filter_taps; k++) {
+            val += history[k] * taps[k];
+        }
+
+        // the tia only outputs positive levels, so block the dc
+        dc_out = val - dc_in + 0.999f * dc_out;
+        dc_in = val;
+
+        auto s = std::max(-1.0f, std::min(1.0f, dc_out));
+        out[i] = std::int16_t(s * 24000);
+        position += cur_step;
+    }
+}
+
+unsigned long audio::get_underrun_count() {
+    return underrun_cnt;
+}
+
+unsigned long audio::get_overrun_count() {
+    return overrun_cnt;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace audio {
+    void init();
+    void set(char, char);
+    void phase0();
+    void phase1();
+    std::uint64_t hash_state(std::uint64_t);
+    std::size_t get_state_size();
+    char* save_state(char*);
+    const char* load_state(const char*);
+    void set_output_rate(unsigned, unsigned);
+    void set_latency(unsigned);
+    void mix(std::int16_t*, unsigned);
+    unsigned long get_underrun_count();
+    unsigned long get_overrun_count();
+}
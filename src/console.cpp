@@ -0,0 +1,135 @@
+#include "misc.hpp"
+#include "console.hpp"
+#include "machine.hpp"
+#include "pia.hpp"
+#include "gfx.hpp"
+#include "audio.hpp"
+#include "frame.hpp"
+#include "input.hpp"
+#include "rom.hpp"
+
+// cpu cycles without a frame after which a rom is taken to hang, about a
+// second of emulated time. the cycles a halted cpu or an idle loop is moved
+// over in one go count as well
+const auto hang_limit = 1200000ul;
+
+// where the cpu starts, the first byte of the cartridge
+const auto start_addr = 0xf000ul;
+
+namespace {
+    // the cartridge of a console that loaded it itself
+    thread_local t_rom own_rom;
+}
+
+bool console::init(const std::string& path) {
+    if (own_rom.load(path) == false) {
+        return false;
+    }
+    init(own_rom);
+    return true;
+}
+
+void console::init(const t_rom& rom) {
+    machine::init();
+    machine::set_rom(rom);
+    machine::set_program_counter(start_addr);
+    pia::init();
+    gfx::init();
+}
+
+// for a saved console to be loaded into the thread, the cartridge it was
+// playing has to be in as well
+void console::set_rom(const t_rom& rom) {
+    machine::set_rom(rom);
+}
+
+// one cpu cycle and the three tia cycles that go with it. a halted cpu
+// waits for the end of the line in one go. returns the cpu cycles it took
+unsigned long console::cycle() {
+    unsigned long waited = 0;
+    if (machine::is_halted() && machine::get_cycle_counter() == 0) {
+        waited = gfx::finish_line();
+        pia::advance(waited);
+    }
+    gfx::cycle();
+    gfx::cycle();
+    gfx::cycle();
+    auto cycles = machine::cycle();
+    pia::cycle();
+    return waited + cycles;
+}
+
+// false if no frame was finished within the hang limit
+bool console::run_frame() {
+    auto frame_cnt = frame::get_count();
+    unsigned long cycles = 0;
+    while (cycles < hang_limit) {
+        cycles += cycle();
+        if (frame::get_count() != frame_cnt) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// all that decides how the console goes on, which is all of its saved
+// state but for the counters of frames, steps and bad opcodes, so one state
+// reached at different frames hashes the same, and the record of ram
+// changes, which is only there to be read. the ram is hashed as it is
+// written, which leaves a few dozen words to mix per call
+std::uint64_t console::hash_state() {
+    auto h = machine::hash_state(hash_seed);
+    h = gfx::hash_state(h);
+    h = pia::hash_state(h);
+    h = audio::hash_state(h);
+    h = frame::hash_state(h);
+    return mix_word(input::hash_state(h));
+}
+
+console::t_counters console::get_counters() {
+    return {
+        frame::get_count(),
+        machine::get_step_counter(),
+        machine::get_bad_opcode_counter(),
+    };
+}
+
+void console::set_counters(const t_counters& val) {
+    frame::set_count(val.frames);
+    machine::set_step_counter(val.steps);
+    machine::set_bad_opcode_counter(val.bad_opcodes);
+}
+
+std::size_t console::get_state_size() {
+    return machine::get_state_size() + gfx::get_state_size() +
+        pia::get_state_size() + audio::get_state_size() +
+        frame::get_state_size() + input::get_state_size();
+}
+
+void console::save_state(char* out) {
+    out = machine::save_state(out);
+    out = gfx::save_state(out);
+    out = pia::save_state(out);
+    out = audio::save_state(out);
+    out = frame::save_state(out);
+    input::save_state(out);
+}
+
+void console::load_state(const char* in) {
+    in = machine::load_state(in);
+    in = gfx::load_state(in);
+    in = pia::load_state(in);
+    in = audio::load_state(in);
+    in = frame::load_state(in);
+    input::load_state(in);
+}
+
+// where a saved state keeps these, the machine coming first in it
+const char* console::get_saved_ram(const char* state) {
+    return state + machine::get_saved_ram_offset();
+}
+
+const std::uint8_t* console::get_saved_ram_changes(const char* state) {
+    auto changes = state + machine::get_saved_ram_changes_offset();
+    return reinterpret_cast<const std::uint8_t*>(changes);
+}
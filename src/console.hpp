@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+class t_rom;
+
+// the chips wired together and clocked as one. all of their state belongs to
+// the thread that calls init, so every thread can run a console of its own,
+// and a console can be saved on one thread and loaded on another. the
+// cartridge is not part of the state, and can be shared by many consoles
+namespace console {
+    // what a console has counted so far, which its hash leaves out
+    struct t_counters {
+        long frames;
+        unsigned long steps;
+        unsigned long bad_opcodes;
+    };
+
+    bool init(const std::string&);
+    void init(const t_rom&);
+    void set_rom(const t_rom&);
+    unsigned long cycle();
+    bool run_frame();
+    std::uint64_t hash_state();
+    t_counters get_counters();
+    void set_counters(const t_counters&);
+    std::size_t get_state_size();
+    void save_state(char*);
+    void load_state(const char*);
+    const char* get_saved_ram(const char*);
+    const std::uint8_t* get_saved_ram_changes(const char*);
+}
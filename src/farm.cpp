@@ -0,0 +1,307 @@
+#include <map>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "farm.hpp"
+#include "machine.hpp"
+#include "frame.hpp"
+#include "rom.hpp"
+#include "sched.hpp"
+
+namespace {
+    struct t_result {
+        const char* status;
+        long frames;
+        double seconds;
+        double wall_seconds;
+        unsigned long bad_opcodes;
+        std::uint64_t frame_hash;
+        std::uint64_t state_hash;
+        std::uint64_t chain_hash;
+    };
+
+    // a rom being run, by its console in the scheduler of the thread
+    struct t_running {
+        std::size_t index;
+        std::unique_ptr<t_rom> rom;
+    };
+
+    // a rom crashes on the first opcode the cpu does not know, and hangs
+    // when it stops finishing frames. null while it runs on. the console
+    // is the one in the thread
+    const char* get_status(bool done, long frame_limit) {
+        if (machine::get_bad_opcode_counter() != 0) {
+            return "crash";
+        }
+        if (done == false) {
+            return "hang";
+        }
+        if (frame::get_count() >= frame_limit) {
+            return "ok";
+        }
+        return nullptr;
+    }
+
+    t_result get_result(const t_scheduler& sched, unsigned id,
+                        const char* status) {
+        auto& stats = sched.get_stats(id);
+        auto& summary = sched.get_summary(id);
+        return {
+            status, stats.frames, stats.seconds, stats.wall_seconds,
+            machine::get_bad_opcode_counter(),
+            summary.frame, summary.state, summary.chain,
+        };
+    }
+
+    // takes roms from the shared index until there are none left, running
+    // up to interleave of them at once on the calling thread
+    void run_roms(const std::vector<std::string>& roms,
+                  std::atomic<std::size_t>& next, long frame_limit,
+                  unsigned interleave, std::vector<t_result>& results) {
+        t_scheduler sched(true);
+        std::vector<t_running> running;
+
+        // false once there is nothing left to start
+        auto start = [&]() {
+            std::size_t i;
+            while ((i = next++) < roms.size()) {
+                std::unique_ptr<t_rom> rom(new t_rom);
+                if (rom->load(roms[i]) == false) {
+                    results[i] = {"error", 0, 0, 0, 0, 0, 0, 0};
+                    continue;
+                }
+                auto id = sched.add(*rom);
+                if (id >= running.size()) {
+                    running.resize(id + 1);
+                }
+                running[id] = {i, std::move(rom)};
+                if (frame_limit <= 0) {
+                    results[i] = get_result(sched, id, "ok");
+                    sched.remove(id);
+                    running[id].rom.reset();
+                    continue;
+                }
+                return true;
+            }
+            return false;
+        };
+
+        while (sched.get_count() < interleave && start()) {
+        }
+        while (sched.get_count() != 0) {
+            unsigned id;
+            auto done = sched.run(id);
+            auto status = get_status(done, frame_limit);
+            if (status != nullptr) {
+                results[running[id].index] = get_result(sched, id, status);
+                sched.remove(id);
+                running[id].rom.reset();
+                while (sched.get_count() < interleave && start()) {
+                }
+            }
+        }
+    }
+
+    // one rom in a child process, which hands its result back through a
+    // pipe. the status is a literal, at the same address in both processes
+    void run_child(const std::string& rom, long frame_limit, int fd) {
+        std::vector<std::string> roms = {rom};
+        std::vector<t_result> results(1);
+        std::atomic<std::size_t> next(0);
+        run_roms(roms, next, frame_limit, 1, results);
+        auto ok = write(fd, results.data(), sizeof(t_result));
+        _exit(ok == sizeof(t_result) ? 0 : 1);
+    }
+
+    // every rom in a process of its own, up to count of them at once, so a
+    // fault of the emulator, which the core can not catch itself, only
+    // takes that rom down. it is reported as one, with the signal on the
+    // error stream. the process is forked before any thread is started
+    void run_isolated(const std::vector<std::string>& roms, unsigned count,
+                      long frame_limit, std::vector<t_result>& results) {
+        struct t_child {
+            std::size_t index;
+            int fd;
+        };
+        std::map<pid_t, t_child> children;
+        std::size_t next = 0;
+
+        while (next < roms.size() || children.empty() == false) {
+            while (children.size() < count && next < roms.size()) {
+                auto i = next++;
+                int fds[2];
+                if (pipe(fds) != 0) {
+                    results[i] = {"error", 0, 0, 0, 0, 0, 0, 0};
+                    continue;
+                }
+                auto pid = fork();
+                if (pid == 0) {
+                    close(fds[0]);
+                    run_child(roms[i], frame_limit, fds[1]);
+                }
+                close(fds[1]);
+                if (pid < 0) {
+                    close(fds[0]);
+                    results[i] = {"error", 0, 0, 0, 0, 0, 0, 0};
+                    continue;
+                }
+                children[pid] = {i, fds[0]};
+            }
+
+            int status;
+            auto pid = waitpid(-1, &status, 0);
+            auto it = children.find(pid);
+            if (pid < 0 || it == children.end()) {
+                continue;
+            }
+            auto& result = results[it->second.index];
+            if (WIFSIGNALED(status) || read(it->second.fd, &result,
+                                            sizeof(result)) != sizeof(result)) {
+                result = {"fault", 0, 0, 0, 0, 0, 0, 0};
+                std::cerr << roms[it->second.index] << " : ";
+                if (WIFSIGNALED(status)) {
+                    std::cerr << strsignal(WTERMSIG(status)) << "\n";
+                } else {
+                    std::cerr << "no result\n";
+                }
+            }
+            close(it->second.fd);
+            children.erase(it);
+        }
+    }
+
+    std::string quote(const std::string& str) {
+        std::string out = "\"";
+        for (char c : str) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (c < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", unsigned(c));
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+        return out + "\"";
+    }
+
+    void print(const std::string& rom, const t_result& r) {
+        auto fps = (r.seconds > 0) ? r.frames / r.seconds : 0.0;
+        char buf[0x200];
+        std::snprintf(buf, sizeof(buf),
+                      "\"status\": \"%s\", \"frames\": %ld, \"seconds\": %.3f, "
+                      "\"wall_seconds\": %.3f, \"fps\": %.1f, "
+                      "\"bad_opcodes\": %lu, "
+                      "\"frame_hash\": \"%016" PRIx64 "\", "
+                      "\"state_hash\": \"%016" PRIx64 "\", "
+                      "\"frames_hash\": \"%016" PRIx64 "\"",
+                      r.status, r.frames, r.seconds, r.wall_seconds, fps,
+                      r.bad_opcodes,
+                      r.frame_hash, r.state_hash, r.chain_hash);
+        std::cout << "{\"rom\": " << quote(rom) << ", " << buf << "}";
+    }
+}
+
+// a directory, taking every file in it, or a manifest with one path per line
+bool farm::list_roms(const std::string& path, std::vector<std::string>& roms) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        std::cerr << "could not open " << path << "\n";
+        return false;
+    }
+
+    if (S_ISDIR(info.st_mode)) {
+        auto dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            std::cerr << "could not open " << path << "\n";
+            return false;
+        }
+        while (auto entry = readdir(dir)) {
+            auto file = path + "/" + entry->d_name;
+            if (stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+                roms.push_back(file);
+            }
+        }
+        closedir(dir);
+        std::sort(roms.begin(), roms.end());
+        return true;
+    }
+
+    std::ifstream manifest(path);
+    std::string line;
+    while (std::getline(manifest, line)) {
+        if (line.empty() == false && line[0] != '#') {
+            roms.push_back(line);
+        }
+    }
+    return true;
+}
+
+// the roms are independent and each takes long against handing it out, so
+// threads simply take the next one from a shared index. each thread runs up
+// to interleave of them at once, a frame at a time, and takes another as
+// one finishes. a rom's seconds are the time it ran, the fps are by those,
+// and its wall seconds the time it took from start to end, waiting its
+// turns included. the results are printed in the order of the list, and
+// only once all are done.
+// a crash is only what the core sees, an opcode the cpu does not know. a
+// fault of the emulator itself takes the whole farm down, unless isolate
+// runs every rom in a process of its own, threads of them at once and
+// without interleaving
+bool farm::run(const std::vector<std::string>& roms, unsigned threads,
+               long frame_limit, unsigned interleave, bool isolate) {
+    interleave = std::max(interleave, 1u);
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    if (threads > roms.size()) {
+        threads = std::max<unsigned>(roms.size(), 1);
+    }
+
+    std::vector<t_result> results(roms.size());
+    auto t0 = std::chrono::steady_clock::now();
+    if (isolate) {
+        run_isolated(roms, threads, frame_limit, results);
+        interleave = 1;
+    } else {
+        std::atomic<std::size_t> next(0);
+        std::vector<std::thread> pool;
+        for (unsigned i = 0; i < threads; i++) {
+            pool.emplace_back([&]() {
+                run_roms(roms, next, frame_limit, interleave, results);
+            });
+        }
+        for (auto& t : pool) {
+            t.join();
+        }
+    }
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+
+    bool all_ok = true;
+    std::cout << "[\n";
+    for (std::size_t i = 0; i < roms.size(); i++) {
+        std::cout << "  ";
+        print(roms[i], results[i]);
+        std::cout << ((i + 1 < roms.size()) ? ",\n" : "\n");
+        all_ok &= (results[i].status == std::string("ok"));
+    }
+    std::cout << "]\n";
+    std::cerr << roms.size() << " roms on " << threads <<
+        (isolate ? " processes, " : " threads, ") << interleave <<
+        " at once on each, in " << dt.count() << " s\n";
+    return all_ok;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// runs a batch of roms headless on a pool of threads, each of which can
+// interleave a number of them, and reports on each of them as json. or
+// on as many processes, one for each rom, so a fault only takes that one
+namespace farm {
+    bool list_roms(const std::string&, std::vector<std::string>&);
+    bool run(const std::vector<std::string>&, unsigned, long, unsigned,
+             bool);
+}
@@ -0,0 +1,157 @@
+#include <atomic>
+#include <algorithm>
+
+#include "misc.hpp"
+#include "frame.hpp"
+#include "triple_buffer.hpp"
+#include "record.hpp"
+#include "verify.hpp"
+#include "input.hpp"
+
+namespace {
+    // finished frames go into the back buffer for the frontend to take from
+    // the other end. only one emulation thread can be presenting
+    t_triple_buffer<frame::t_buffer> screens;
+    std::atomic<bool> presenting;
+
+    // the frame being drawn, which keeps what was there the frame before
+    // wherever the next one draws less. it is drawn into the buffer of the
+    // thread, or straight into one of the caller's
+    thread_local frame::t_buffer screen;
+    thread_local frame::t_buffer* target;
+    thread_local bool skipping;
+    thread_local unsigned scr_cnt;
+    thread_local bool drawing;
+    // whether the frame that ended last had every pixel drawn, which leaves
+    // nothing of the one before it in the buffer
+    thread_local bool whole;
+
+    thread_local long frame_cnt;
+    thread_local bool frame_done;
+    thread_local unsigned frames_per_second;
+    thread_local t_millisecond_timer timer;
+
+    // the pacing belongs to the thread, not to the console that runs on it
+    template <typename t_archive>
+    void transfer(t_archive& ar) {
+        ar(scr_cnt, drawing, frame_cnt, frame_done);
+    }
+}
+
+void frame::init() {
+    std::fill(screen.begin(), screen.end(), 0x00);
+    target = &screen;
+    scr_cnt = 0;
+    drawing = false;
+    frame_cnt = 0;
+    frame_done = false;
+    frames_per_second = 60;
+}
+
+void frame::begin_drawing() {
+    drawing = true;
+    timer.reset();
+}
+
+void frame::send_pixel(char color) {
+    if (drawing == false || skipping) {
+        return;
+    }
+    if (scr_cnt < target->size()) {
+        (*target)[scr_cnt] = color;
+        scr_cnt++;
+    }
+}
+
+void frame::end() {
+    whole = (skipping == false && scr_cnt == target->size());
+    record::push(*target);
+    verify::push(*target, frame_cnt);
+    if (presenting.load(std::memory_order_relaxed)) {
+        screens.get_back() = *target;
+        screens.publish();
+    }
+    scr_cnt = 0;
+    frame_done = true;
+    frame_cnt++;
+    input::next_frame(frame_cnt);
+}
+
+// null to draw into the buffer of the thread again
+void frame::set_target(t_buffer* buffer) {
+    target = (buffer != nullptr) ? buffer : &screen;
+}
+
+// frames nobody looks at are run without writing their pixels, or working
+// out their colours. like the target, this belongs to the thread rather
+// than the console, and can change from one frame to the next
+void frame::set_skipping(bool val) {
+    skipping = val;
+}
+
+bool frame::is_skipping() {
+    return skipping;
+}
+
+// whether the frames of the emulation thread go to the frontend
+void frame::set_presenting(bool val) {
+    presenting = val;
+}
+
+const frame::t_buffer* frame::take() {
+    return screens.take();
+}
+
+long frame::get_count() {
+    return frame_cnt;
+}
+
+void frame::set_count(long val) {
+    frame_cnt = val;
+}
+
+bool frame::is_whole() {
+    return whole;
+}
+
+// never when there is no frame rate to keep
+bool frame::is_waiting() {
+    if (frame_done && frames_per_second != 0) {
+        if (frames_per_second * timer.get_ticks() < 1000 * frame_cnt) {
+            return true;
+        } else {
+            frame_done = false;
+            return false;
+        }
+    }
+    return false;
+}
+
+void frame::set_frames_per_second(unsigned val) {
+    frames_per_second = val;
+}
+
+// where the beam is within the frame, and whether one has ended since the
+// pacing last let the thread go on. not the count of frames
+std::uint64_t frame::hash_state(std::uint64_t h) {
+    return hash_word(h, scr_cnt | std::uint64_t(drawing) << 32 |
+                     std::uint64_t(frame_done) << 40);
+}
+
+std::size_t frame::get_state_size() {
+    t_state_size ar;
+    transfer(ar);
+    return ar.get();
+}
+
+char* frame::save_state(char* out) {
+    t_state_saver ar(out);
+    transfer(ar);
+    return ar.get();
+}
+
+const char* frame::load_state(const char* in) {
+    t_state_loader ar(in);
+    transfer(ar);
+    return ar.get();
+}
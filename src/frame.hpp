@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+namespace frame {
+    const unsigned width = 160;
+    const unsigned height = 192;
+    using t_buffer = std::array<char, width * height>;
+
+    void init();
+    void begin_drawing();
+    void send_pixel(char);
+    void end();
+    void set_target(t_buffer*);
+    void set_skipping(bool);
+    bool is_skipping();
+    void set_presenting(bool);
+    const t_buffer* take();
+    long get_count();
+    void set_count(long);
+    bool is_whole();
+    bool is_waiting();
+    void set_frames_per_second(unsigned);
+    std::uint64_t hash_state(std::uint64_t);
+    std::size_t get_state_size();
+    char* save_state(char*);
+    const char* load_state(const char*);
+}
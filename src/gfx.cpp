@@ -4,11 +4,14 @@
 #include <string>
 #include <chrono>
 #include <cstdio>
+#include <cstdint>
 
 #include "misc.hpp"
 #include "gfx.hpp"
 #include "machine.hpp"
-#include "sdl.hpp"
+#include "input.hpp"
+#include "audio.hpp"
+#include "frame.hpp"
 
 const auto not_a_color = char(0xff);
 const auto line_width = 160u;
@@ -17,23 +20,29 @@ const auto line_start = 68u;
 using std::cout;
 
 namespace {
-    unsigned hor_cnt;
-    unsigned ver_cnt;
-    bool vsyncing;
-    bool wsync_next_line;
-    char set_addr;
-    char set_val;
-    unsigned long set_delay;
-    bool set_delay_active;
-
-    char background_color;
-    char resmp[2];
+    thread_local unsigned hor_cnt;
+    thread_local unsigned ver_cnt;
+    thread_local bool vsyncing;
+    thread_local bool initial_vsync;
+    thread_local bool wsync_next_line;
+    thread_local char set_addr;
+    thread_local char set_val;
+    thread_local unsigned long set_delay;
+    thread_local bool set_delay_active;
+
+    thread_local char background_color;
+    thread_local char resmp[2];
 }
 
+// the shared object logic, with the colour lookup of the concrete object
+// resolved at compile time so the whole pixel pipeline can be inlined
+template <class t_derived>
 class t_object {
 protected:
-    std::vector<unsigned> decoders;
+    // bit k set for a copy starting at position 16 * k
+    unsigned copies;
     unsigned width;
+    unsigned width_shift;
     unsigned width_cnt;
     unsigned pos_cnt;
     char graphics;
@@ -45,11 +54,14 @@ protected:
     bool reflected;
 
     void increment() {
-        pos_cnt = (pos_cnt + 1) % line_width;
+        pos_cnt++;
+        if (pos_cnt == line_width) {
+            pos_cnt = 0;
+        }
     }
 
-    virtual char get_color() {
-        auto idx = 8 * (width_cnt - 1) / width;
+    char get_color() {
+        auto idx = (8 * (width_cnt - 1)) >> width_shift;
 
         if (reflected) {
             idx = 7 - idx;
@@ -59,16 +71,17 @@ protected:
         if (delayed) {
             val = delayed_graphics;
         }
-        if (get_bit(val, int(idx)) == 1) {
+        if (((val >> idx) & 1) != 0) {
             return color;
         }
         return not_a_color;
     }
 
 public:
-    virtual void init() {
-        decoders = {0};
+    void init() {
+        copies = 1;
         width = 0;
+        width_shift = 0;
         width_cnt = 0;
         pos_cnt = 0;
         offset = 0;
@@ -80,8 +93,8 @@ public:
         graphics = 0;
     }
 
-    void set_decoders(const std::vector<unsigned>& val) {
-        decoders = val;
+    void set_copies(unsigned val) {
+        copies = val;
     }
 
     void reset() {
@@ -90,6 +103,10 @@ public:
 
     void set_width(unsigned val) {
         width = val;
+        width_shift = 0;
+        while ((2u << width_shift) <= val) {
+            width_shift++;
+        }
     }
 
     void set_graphics(char val)  {
@@ -121,6 +138,55 @@ public:
         reflected = val;
     }
 
+    bool is_blank() {
+        return graphics == 0 && delayed_graphics == 0;
+    }
+
+    // the counters all fit in 16 bits and the rest in a byte each
+    std::uint64_t hash(std::uint64_t h) {
+        h = hash_word(h, copies | width << 16 |
+                      std::uint64_t(width_cnt) << 32 |
+                      std::uint64_t(pos_cnt) << 48);
+        return hash_word(h, delay_cnt | graphics << 16 |
+                         unsigned(delayed_graphics) << 24 |
+                         std::uint64_t(std::uint8_t(offset)) << 32 |
+                         std::uint64_t(std::uint8_t(color)) << 40 |
+                         std::uint64_t(delayed) << 48 |
+                         std::uint64_t(reflected) << 56);
+    }
+
+    // same as n calls to color_cycle() but for the pixels, which are lost,
+    // with n not more than a line
+    void skip(unsigned n) {
+        if (delay_cnt != 0) {
+            if (n >= delay_cnt) {
+                delay_cnt = 0;
+                delayed_graphics = graphics;
+            } else {
+                delay_cnt -= n;
+            }
+        }
+
+        auto hit = false;
+        unsigned last = 0;
+        for (unsigned k = 0; (copies >> k) != 0; k++) {
+            if (((copies >> k) & 1) == 0) {
+                continue;
+            }
+            auto t = (16 * k + line_width - pos_cnt) % line_width;
+            if (t < n && (hit == false || t > last)) {
+                hit = true;
+                last = t;
+            }
+        }
+        if (hit) {
+            width_cnt = width + last;
+        }
+        width_cnt = (width_cnt > n) ? width_cnt - n : 0;
+
+        pos_cnt = (pos_cnt + n) % line_width;
+    }
+
     void move() {
         offset >>= 4;
         if (offset < 8u) {
@@ -141,14 +207,13 @@ public:
             }
         }
 
-        auto& v = decoders;
-        if (std::find(v.begin(), v.end(), pos_cnt) != v.end()) {
+        if ((pos_cnt & 0x0f) == 0 && ((copies >> (pos_cnt >> 4)) & 1) != 0) {
             width_cnt = width;
         }
 
         char ret = not_a_color;
         if (width_cnt != 0) {
-            ret = get_color();
+            ret = static_cast<t_derived*>(this)->get_color();
             width_cnt--;
         }
 
@@ -158,64 +223,94 @@ public:
     }
 };
 
-class t_ball : public t_object {
+class t_ball : public t_object<t_ball> {
 };
 
-class t_missile : public t_object {
+class t_missile : public t_object<t_missile> {
 };
 
-class t_player : public t_object {
+class t_player : public t_object<t_player> {
 };
 
-class t_playfield : public t_object {
+class t_playfield : public t_object<t_playfield> {
+    friend class t_object<t_playfield>;
+
     std::array<char, 3> reg;
     bool score_mode;
     char score_mode_left_color;
     char score_mode_right_color;
     bool priority;
 
-    char get_color() {
-        auto j = pos_cnt / 4;
-        if (j >= 20) {
-            j -= 20;
-            if (reflected) {
-                j = 19 - j;
+    // one bit per playfield column, rebuilt whenever a register or the
+    // reflection changes
+    std::uint64_t mask;
+
+    void update_mask() {
+        mask = 0;
+        for (unsigned col = 0; col < 40; col++) {
+            auto j = col;
+            if (j >= 20) {
+                j -= 20;
+                if (reflected) {
+                    j = 19 - j;
+                }
+            }
+            bool pf0 = j < 4u && get_bit(reg[0], 4 + j) == 1;
+            bool pf1 = j >= 4 && j < 12 && get_bit(reg[1], (7 - (j - 4))) == 1;
+            bool pf2 = j >= 12 && get_bit(reg[2], j - 12) == 1;
+            if (pf0 || pf1 || pf2) {
+                mask |= std::uint64_t(1) << col;
             }
         }
-        bool pf0 = j < 4u && get_bit(reg[0], 4 + j) == 1;
-        bool pf1 = j >= 4 && j < 12 && get_bit(reg[1], (7 - (j - 4))) == 1;
-        bool pf2 = j >= 12 && get_bit(reg[2], j - 12) == 1;
-        char res = not_a_color;
-        if (pf0 || pf1 || pf2) {
-            if (score_mode) {
-                if (pos_cnt < line_width / 2) {
-                    res = score_mode_left_color;
-                } else {
-                    res = score_mode_right_color;
-                }
-            } else {
-                res = color;
+    }
+
+    char get_color() {
+        if (((mask >> (pos_cnt / 4)) & 1) == 0) {
+            return not_a_color;
+        }
+        if (score_mode) {
+            if (pos_cnt < line_width / 2) {
+                return score_mode_left_color;
             }
+            return score_mode_right_color;
         }
-        return res;
+        return color;
     }
 
 public:
     void init() {
-        t_object::init();
+        t_object<t_playfield>::init();
         std::fill(reg.begin(), reg.end(), 0);
         score_mode = false;
         score_mode_left_color = 0;
         score_mode_right_color = 0;
         priority = false;
+        mask = 0;
+    }
+
+    bool is_blank() {
+        return mask == 0;
+    }
+
+    std::uint64_t hash(std::uint64_t h) {
+        h = t_object<t_playfield>::hash(h);
+        h = hash_word(h, score_mode | score_mode_left_color << 8 |
+                      score_mode_right_color << 16 | priority << 24);
+        return hash_word(h, mask);
     }
 
     void set_register(unsigned idx, char val) {
         if (idx < 3) {
             reg[idx] = val;
+            update_mask();
         }
     }
 
+    void set_reflected(bool val) {
+        reflected = val;
+        update_mask();
+    }
+
     void set_score_mode(bool val) {
         score_mode = val;
     }
@@ -234,36 +329,66 @@ public:
 };
 
 namespace {
-    t_player plr[2];
-    t_missile msl[2];
-    t_playfield plf;
-    bool playfield_priority;
-    t_ball ball;
-
-    bool cxm0p1;
-    bool cxm0p0;
-    bool cxm1p0;
-    bool cxm1p1;
-    bool cxp0pf;
-    bool cxp0bl;
-    bool cxp1pf;
-    bool cxp1bl;
-    bool cxm0pf;
-    bool cxm0bl;
-    bool cxm1pf;
-    bool cxm1bl;
-    bool cxblpf;
-    bool cxp0p1;
-    bool cxm0m1;
+    thread_local t_player plr[2];
+    thread_local t_missile msl[2];
+    thread_local t_playfield plf;
+    thread_local bool playfield_priority;
+    thread_local t_ball ball;
+
+    // the collision latches, two per register: bit 2 * i is d7 and bit
+    // 2 * i + 1 is d6 of the register at address i
+    thread_local unsigned collisions;
+
+    // objects, as bits of the mask of what draws at a pixel
+    enum { obj_pf, obj_bl, obj_p0, obj_p1, obj_m0, obj_m1 };
+
+    const int collision_pairs[16][2] = {
+        {obj_m0, obj_p1}, {obj_m0, obj_p0},
+        {obj_m1, obj_p0}, {obj_m1, obj_p1},
+        {obj_p0, obj_pf}, {obj_p0, obj_bl},
+        {obj_p1, obj_pf}, {obj_p1, obj_bl},
+        {obj_m0, obj_pf}, {obj_m0, obj_bl},
+        {obj_m1, obj_pf}, {obj_m1, obj_bl},
+        {obj_bl, obj_pf}, {-1, -1},
+        {obj_p0, obj_p1}, {obj_m0, obj_m1},
+    };
+
+    // latches set by each combination of drawing objects, the same for
+    // every console
+    std::array<unsigned, 64> make_collision_table() {
+        std::array<unsigned, 64> table;
+        for (unsigned drawn = 0; drawn < table.size(); drawn++) {
+            unsigned cx = 0;
+            for (unsigned i = 0; i < 16; i++) {
+                auto a = collision_pairs[i][0];
+                auto b = collision_pairs[i][1];
+                if (a >= 0 && get_bit(drawn, a) && get_bit(drawn, b)) {
+                    cx |= 1u << i;
+                }
+            }
+            table[drawn] = cx;
+        }
+        return table;
+    }
+
+    const auto collision_table = make_collision_table();
+
+    // everything of a console that lives in the tia
+    template <typename t_archive>
+    void transfer(t_archive& ar) {
+        ar(hor_cnt, ver_cnt, vsyncing, initial_vsync, wsync_next_line);
+        ar(set_addr, set_val, set_delay, set_delay_active);
+        ar(background_color, resmp, plr, msl, plf, playfield_priority, ball);
+        ar(collisions);
+    }
 
     void set_vsync(bool on) {
         if (vsyncing == false && on) {
-            static bool initial = true;
-            if (initial) {
-                sdl::begin_drawing();
-                initial = false;
+            if (initial_vsync) {
+                frame::begin_drawing();
+                initial_vsync = false;
             } else {
-                sdl::render();
+                frame::end();
             }
 
             ver_cnt = 0;
@@ -280,21 +405,136 @@ namespace {
     }
 
     void cxclr() {
-        cxm0p1 = 0;
-        cxm0p0 = 0;
-        cxm1p0 = 0;
-        cxm1p1 = 0;
-        cxp0pf = 0;
-        cxp0bl = 0;
-        cxp1pf = 0;
-        cxp1bl = 0;
-        cxm0pf = 0;
-        cxm0bl = 0;
-        cxm1pf = 0;
-        cxm1bl = 0;
-        cxblpf = 0;
-        cxp0p1 = 0;
-        cxm0m1 = 0;
+        collisions = 0;
+    }
+
+    // whether the pixels of the line are drawn at all. the objects are
+    // clocked and collide all the same
+    bool is_shown() {
+        return ver_cnt >= 40 && frame::is_skipping() == false;
+    }
+
+    void draw_pixel(bool shown) {
+        char color = background_color;
+        auto add_color = [&](char new_color) {
+            if (new_color != not_a_color) {
+                color = new_color;
+            }
+        };
+
+        auto pf = plf.color_cycle();
+        auto bl = ball.color_cycle();
+        auto p0 = plr[0].color_cycle();
+        auto p1 = plr[1].color_cycle();
+        auto m0 = msl[0].color_cycle();
+        auto m1 = msl[1].color_cycle();
+
+        unsigned drawn = (pf != not_a_color) << obj_pf;
+        drawn |= (bl != not_a_color) << obj_bl;
+        drawn |= (p0 != not_a_color) << obj_p0;
+        drawn |= (p1 != not_a_color) << obj_p1;
+        drawn |= (m0 != not_a_color) << obj_m0;
+        drawn |= (m1 != not_a_color) << obj_m1;
+        collisions |= collision_table[drawn];
+
+        if (shown == false) {
+            return;
+        }
+
+        if (playfield_priority) {
+            add_color(p1);
+            add_color(m1);
+            add_color(p0);
+            add_color(m0);
+            add_color(pf);
+            add_color(bl);
+        } else {
+            add_color(pf);
+            add_color(bl);
+            add_color(p1);
+            add_color(m1);
+            add_color(p0);
+            add_color(m0);
+        }
+
+        frame::send_pixel(color);
+    }
+
+    // blank objects can't collide, and latches only ever get set, so over a
+    // span in which the objects that draw have nothing left to latch only
+    // the counters move. the pixels are needed just on shown lines, and
+    // there they are all background if nothing draws
+    void draw_span(unsigned n) {
+        unsigned active = !plf.is_blank() << obj_pf;
+        active |= !ball.is_blank() << obj_bl;
+        active |= !plr[0].is_blank() << obj_p0;
+        active |= !plr[1].is_blank() << obj_p1;
+        active |= !msl[0].is_blank() << obj_m0;
+        active |= !msl[1].is_blank() << obj_m1;
+        auto shown = is_shown();
+        auto latching = (collision_table[active] & ~collisions) != 0;
+
+        if (latching || (shown && active != 0)) {
+            for (unsigned i = 0; i < n; i++) {
+                draw_pixel(shown);
+            }
+            return;
+        }
+
+        if (shown) {
+            for (unsigned i = 0; i < n; i++) {
+                frame::send_pixel(background_color);
+            }
+        }
+        plf.skip(n);
+        ball.skip(n);
+        plr[0].skip(n);
+        plr[1].skip(n);
+        msl[0].skip(n);
+        msl[1].skip(n);
+    }
+
+    // the sound generators get each of their two phases twice a line
+    void clock_audio(unsigned from, unsigned to) {
+        if (from <= 9 && 9 < to) {
+            audio::phase0();
+        }
+        if (from <= 37 && 37 < to) {
+            audio::phase1();
+        }
+        if (from <= 81 && 81 < to) {
+            audio::phase0();
+        }
+        if (from <= 149 && 149 < to) {
+            audio::phase1();
+        }
+    }
+
+    // clocks the tia through a span that holds no pending write and no
+    // wsync release
+    void run(unsigned long clocks) {
+        auto end = line_width + line_start;
+        while (clocks != 0) {
+            if (hor_cnt < line_start) {
+                auto n = std::min<unsigned long>(clocks, line_start - hor_cnt);
+                clock_audio(hor_cnt, hor_cnt + n);
+                hor_cnt += n;
+                clocks -= n;
+            } else {
+                auto n = std::min<unsigned long>(clocks, end - hor_cnt);
+                clock_audio(hor_cnt, hor_cnt + n);
+                draw_span(n);
+                hor_cnt += n;
+                clocks -= n;
+                if (hor_cnt == end) {
+                    hor_cnt = 0;
+                    if (machine::is_halted()) {
+                        wsync_next_line = true;
+                    }
+                    ver_cnt++;
+                }
+            }
+        }
     }
 }
 
@@ -307,28 +547,16 @@ void gfx::set_with_delay(char addr, char val) {
 
 void gfx::set(char addr, char val) {
     const unsigned width_table[] = { 1, 2, 4, 8 };
+    const unsigned copies_table[] = {
+        0x01, 0x03, 0x05, 0x07, 0x11, 0x00, 0x15, 0x00
+    };
 
     auto set_number_size = [&](unsigned idx, char val) {
         msl[idx].set_width(width_table[val >> 4]);
 
         auto ns = val & 0x07u;
-        std::vector<unsigned> decoders;
-        if (ns == 0) {
-            decoders = {0};
-        } else if (ns == 1) {
-            decoders = {0, 16};
-        } else if (ns == 2) {
-            decoders = {0, 32};
-        } else if (ns == 3) {
-            decoders = {0, 16, 32};
-        } else if (ns == 4) {
-            decoders = {0, 64};
-        } else if (ns == 6) {
-            decoders = {0, 32, 64};
-        }
-
-        msl[idx].set_decoders(decoders);
-        plr[idx].set_decoders(decoders);
+        msl[idx].set_copies(copies_table[ns]);
+        plr[idx].set_copies(copies_table[ns]);
 
         if (ns == 5) {
             plr[idx].set_width(16);
@@ -430,6 +658,10 @@ void gfx::set(char addr, char val) {
         ball.reset();
         break;
 
+    case 0x15: case 0x16: case 0x17: case 0x18: case 0x19: case 0x1a:
+        audio::set(addr, val);
+        break;
+
     case 0x1b:
         plr[0].set_graphics(val);
         break;
@@ -514,48 +746,18 @@ void gfx::set(char addr, char val) {
 }
 
 char gfx::get(char addr) {
-    auto cx = [](char d7, char d6) -> char {
-        return (d7 << 7) | (d6 << 6);
-    };
-
     char res = 0;
 
     switch (addr) {
 
-    case 0x00:
-        res = cx(cxm0p1, cxm0p0);
-        break;
-
-    case 0x01:
-        res = cx(cxm1p0, cxm1p1);
-        break;
-
-    case 0x02:
-        res = cx(cxp0pf, cxp0bl);
-        break;
-
-    case 0x03:
-        res = cx(cxp1pf, cxp1bl);
-        break;
-
-    case 0x04:
-        res = cx(cxm0pf, cxm0bl);
-        break;
-
-    case 0x05:
-        res = cx(cxm1pf, cxm1bl);
-        break;
-
-    case 0x06:
-        res = cx(cxblpf, 0);
-        break;
-
-    case 0x07:
-        res = cx(cxp0p1, cxm0m1);
+    case 0x00: case 0x01: case 0x02: case 0x03:
+    case 0x04: case 0x05: case 0x06: case 0x07:
+        res = ((collisions >> (2 * addr)) & 1) << 7;
+        res |= ((collisions >> (2 * addr + 1)) & 1) << 6;
         break;
 
     case 0x0c:
-        res = sdl::get_key(sdl::key_left_trigger);
+        res = input::get(input::key_left_trigger);
         res ^= 1;
         res <<= 7;
         break;
@@ -569,6 +771,7 @@ bool gfx::init() {
     hor_cnt = 0;
     ver_cnt = 0;
     vsyncing = false;
+    initial_vsync = true;
 
     plf.init();
     plf.set_width(line_width);
@@ -592,29 +795,58 @@ bool gfx::init() {
     wsync_next_line = false;
     set_delay_active = false;
 
-    auto success = sdl::init();
+    audio::init();
+    frame::init();
+    input::init();
 
-    return success;
+    return true;
 }
 
-void gfx::close() {
-    sdl::close();
+bool gfx::is_waiting() {
+    return frame::is_waiting();
 }
 
-void gfx::poll() {
-    sdl::poll();
+void gfx::set_frames_per_second(unsigned val) {
+    frame::set_frames_per_second(val);
 }
 
-bool gfx::is_running() {
-    return sdl::is_running();
+// the beam, the pending write, the objects and the latches
+std::uint64_t gfx::hash_state(std::uint64_t h) {
+    h = hash_word(h, hor_cnt | std::uint64_t(ver_cnt) << 32);
+    h = hash_word(h, collisions | std::uint64_t(vsyncing) << 32 |
+                  std::uint64_t(initial_vsync) << 40 |
+                  std::uint64_t(wsync_next_line) << 48 |
+                  std::uint64_t(set_delay_active) << 56);
+    h = hash_word(h, set_addr | set_val << 8 | background_color << 16 |
+                  unsigned(resmp[0]) << 24 |
+                  std::uint64_t(std::uint8_t(resmp[1])) << 32 |
+                  std::uint64_t(playfield_priority) << 40);
+    h = hash_word(h, set_delay);
+    h = plf.hash(h);
+    h = ball.hash(h);
+    for (unsigned i = 0; i < 2; i++) {
+        h = plr[i].hash(h);
+        h = msl[i].hash(h);
+    }
+    return h;
 }
 
-bool gfx::is_waiting() {
-    return sdl::is_waiting();
+std::size_t gfx::get_state_size() {
+    t_state_size ar;
+    transfer(ar);
+    return ar.get();
 }
 
-void gfx::set_frames_per_second(unsigned val) {
-    sdl::set_frames_per_second(val);
+char* gfx::save_state(char* out) {
+    t_state_saver ar(out);
+    transfer(ar);
+    return ar.get();
+}
+
+const char* gfx::load_state(const char* in) {
+    t_state_loader ar(in);
+    transfer(ar);
+    return ar.get();
 }
 
 void gfx::print_info() {
@@ -626,62 +858,9 @@ void gfx::cycle() {
     // }
 
     if (hor_cnt >= line_start) {
-        char color = background_color;
-        auto add_color = [&](char new_color) {
-            if (new_color != not_a_color) {
-                color = new_color;
-            }
-        };
-
-        auto pf = plf.color_cycle();
-        auto bl = ball.color_cycle();
-        auto p0 = plr[0].color_cycle();
-        auto p1 = plr[1].color_cycle();
-        auto m0 = msl[0].color_cycle();
-        auto m1 = msl[1].color_cycle();
-
-        auto set_cx = [&](bool& cx, char c0, char c1) {
-            if (c0 != not_a_color && c1 != not_a_color) {
-                cx = true;
-            }
-        };
-
-        set_cx(cxm0p1, m0, p1);
-        set_cx(cxm0p0, m0, p0);
-        set_cx(cxm1p0, m1, p0);
-        set_cx(cxm1p1, m1, p1);
-        set_cx(cxp0pf, p0, pf);
-        set_cx(cxp0bl, p0, bl);
-        set_cx(cxp1pf, p1, pf);
-        set_cx(cxp1bl, p1, bl);
-        set_cx(cxm0pf, m0, pf);
-        set_cx(cxm0bl, m0, bl);
-        set_cx(cxm1pf, m1, pf);
-        set_cx(cxm1bl, m1, bl);
-        set_cx(cxblpf, bl, pf);
-        set_cx(cxp0p1, p0, p1);
-        set_cx(cxm0m1, m0, m1);
-
-        if (playfield_priority) {
-            add_color(p1);
-            add_color(m1);
-            add_color(p0);
-            add_color(m0);
-            add_color(pf);
-            add_color(bl);
-        } else {
-            add_color(pf);
-            add_color(bl);
-            add_color(p1);
-            add_color(m1);
-            add_color(p0);
-            add_color(m0);
-        }
-
-        if (ver_cnt >= 40) {
-            sdl::send_pixel(color);
-        }
+        draw_pixel(is_shown());
     }
+    clock_audio(hor_cnt, hor_cnt + 1);
     hor_cnt++;
     if (hor_cnt == line_width + line_start) {
         hor_cnt = 0;
@@ -703,3 +882,30 @@ void gfx::cycle() {
         }
     }
 }
+
+unsigned long gfx::finish_line() {
+    // the cpu sits on wsync, so nothing but the tia changes until it resumes
+    // at hor_cnt 6 of the next line. clock whole cpu cycles up to the one in
+    // which that happens and let the caller take it from there
+    if (set_delay_active || machine::is_halted() == false) {
+        return 0;
+    }
+
+    unsigned long clocks = 6;
+    if (wsync_next_line == false) {
+        clocks += line_width + line_start;
+    }
+    clocks -= hor_cnt;
+    auto cycles = (clocks - 1) / 3;
+    run(3 * cycles);
+
+    return cycles;
+}
+
+bool gfx::is_write_pending() {
+    return set_delay_active;
+}
+
+void gfx::advance(unsigned long clocks) {
+    run(clocks);
+}
@@ -1,15 +1,22 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 namespace gfx {
     bool init();
-    bool is_running();
     bool is_waiting();
     void set(char, char);
     void set_with_delay(char, char);
     char get(char);
-    void poll();
     void cycle();
+    unsigned long finish_line();
+    bool is_write_pending();
+    void advance(unsigned long);
     void print_info();
+    std::uint64_t hash_state(std::uint64_t);
+    std::size_t get_state_size();
+    char* save_state(char*);
+    const char* load_state(const char*);
     void set_frames_per_second(unsigned);
-    void close();
 }
@@ -0,0 +1,144 @@
+#include <array>
+#include <atomic>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include "misc.hpp"
+#include "input.hpp"
+
+const char* const key_names[input::key_count] = {
+    "right", "left", "down", "up", "fire", "fire2",
+};
+
+namespace {
+    // written by the frontend thread, read by the emulation thread. a key
+    // pressed and released between two reads still counts as pressed once
+    std::array<std::atomic<bool>, input::key_count> latched;
+    std::array<std::atomic<bool>, input::key_count> held;
+
+    // from the frame on, exactly the keys of the mask are held
+    struct t_script_step {
+        long frame;
+        unsigned mask;
+    };
+
+    // the script belongs to the emulation thread that loaded it, and works
+    // on latches of its own
+    thread_local std::vector<t_script_step> script;
+    thread_local unsigned script_pos;
+    thread_local unsigned script_latched;
+    thread_local unsigned script_held;
+
+    // the latches go with the console, the script stays with the thread
+    template <typename t_archive>
+    void transfer(t_archive& ar) {
+        ar(script_latched, script_held);
+    }
+}
+
+// only the script side, the frontend keys are left as they are
+void input::init() {
+    script.clear();
+    script_pos = 0;
+    script_latched = 0;
+    script_held = 0;
+}
+
+void input::press(t_key key) {
+    held[key] = true;
+    latched[key] = true;
+}
+
+void input::release(t_key key) {
+    held[key] = false;
+}
+
+bool input::get(t_key key) {
+    auto res = latched[key].load();
+    latched[key] = held[key].load();
+
+    res |= (script_latched >> key) & 1;
+    script_latched = (script_latched & ~(1u << key)) | (script_held & (1u << key));
+    return res;
+}
+
+// exactly the keys of the mask are held from now on, the way a script step
+// holds them
+void input::hold(unsigned mask) {
+    script_held = mask;
+    script_latched |= script_held;
+}
+
+// one step per line : the frame it starts at, then the names of the keys
+// held from then on. # starts a comment
+bool input::load_script(const std::string& path) {
+    std::ifstream file(path);
+    if (file.good() == false) {
+        std::cerr << "could not open input script " << path << "\n";
+        return false;
+    }
+
+    init();
+    std::string line;
+    unsigned line_cnt = 0;
+    while (std::getline(file, line)) {
+        line_cnt++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        t_script_step step = {0, 0};
+        if (!(words >> step.frame)) {
+            continue;
+        }
+        std::string name;
+        while (words >> name) {
+            auto it = std::find(key_names, key_names + key_count, name);
+            if (it == key_names + key_count) {
+                std::cerr << path << ":" << line_cnt << " : unknown key " <<
+                    name << "\n";
+                return false;
+            }
+            step.mask |= 1u << (it - key_names);
+        }
+        script.push_back(step);
+    }
+    std::stable_sort(script.begin(), script.end(),
+        [](const t_script_step& a, const t_script_step& b) {
+            return a.frame < b.frame;
+        });
+    next_frame(0);
+    return true;
+}
+
+// called by the emulation before it starts on a frame
+void input::next_frame(long frame) {
+    while (script_pos < script.size() && script[script_pos].frame <= frame) {
+        script_held = script[script_pos].mask;
+        script_latched |= script_held;
+        script_pos++;
+    }
+}
+
+std::uint64_t input::hash_state(std::uint64_t h) {
+    return hash_word(h, script_latched | std::uint64_t(script_held) << 32);
+}
+
+std::size_t input::get_state_size() {
+    t_state_size ar;
+    transfer(ar);
+    return ar.get();
+}
+
+char* input::save_state(char* out) {
+    t_state_saver ar(out);
+    transfer(ar);
+    return ar.get();
+}
+
+const char* input::load_state(const char* in) {
+    t_state_loader ar(in);
+    transfer(ar);
+    return ar.get();
+}
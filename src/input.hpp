@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// the state of the controls as the emulation sees it, fed by the frontend or
+// by an input script
+namespace input {
+    enum t_key {
+        key_right,
+        key_left,
+        key_down,
+        key_up,
+        key_left_trigger,
+        key_right_trigger,
+        key_count,
+    };
+
+    void init();
+    void press(t_key);
+    void release(t_key);
+    bool get(t_key);
+    void hold(unsigned);
+    bool load_script(const std::string&);
+    void next_frame(long);
+    std::uint64_t hash_state(std::uint64_t);
+    std::size_t get_state_size();
+    char* save_state(char*);
+    const char* load_state(const char*);
+}
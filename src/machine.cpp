@@ -1,6 +1,4 @@
 #include <iostream>
-#include <fstream>
-#include <vector>
 #include <algorithm>
 #include <iomanip>
 #include <functional>
@@ -9,32 +7,63 @@
 #include "misc.hpp"
 #include "gfx.hpp"
 #include "pia.hpp"
+#include "rom.hpp"
 
 using std::cout;
 
 namespace {
-    bool reset_flag;
-    bool nmi_flag;
-    bool irq_flag;
+    thread_local bool reset_flag;
+    thread_local bool nmi_flag;
+    thread_local bool irq_flag;
+
+    thread_local bool ready;
+
+    thread_local std::array<char, machine::ram_size> ram;
+    // a bit for each byte of ram whose value a write changed since the
+    // changes were last cleared, bit i % 8 of byte i / 8
+    thread_local std::array<std::uint8_t, machine::ram_size / 8> ram_changes;
+    // the sum of a term for each byte of ram, which a write keeps up to date
+    // by swapping the term of the byte it changes
+    thread_local std::uint64_t ram_hash;
+    // the cartridge, which is not part of the state but shared by all the
+    // consoles that play it
+    thread_local const char* rom_data;
+    thread_local unsigned rom_mask;
+
+    thread_local t_addr arg;
+    thread_local unsigned r_cyc;
+    thread_local unsigned w_cyc;
+    thread_local unsigned long step_count;
+    thread_local unsigned long cycle_count;
+    thread_local unsigned long bad_opcode_count;
 
-    bool ready;
+    // registers
 
-    std::array<char, 0x10000> memory;
+    thread_local t_addr pc; // program counter
+    thread_local char sp; // stack pointer
+    thread_local char ra; // accumulator
+    thread_local char rx; // x
+    thread_local char ry; // y
+    thread_local char rp; // processor status, apart from the flags below
 
-    t_addr arg;
-    unsigned r_cyc;
-    unsigned w_cyc;
-    unsigned long step_count;
-    unsigned long cycle_count;
+    // n and z are kept as the byte they were last derived from, and all
+    // four are only folded into rp when the status is read as a whole
 
-    // registers
+    thread_local char flag_n; // negative if bit 7 is set
+    thread_local char flag_z; // zero if this is zero
+    thread_local bool flag_c; // carry
+    thread_local bool flag_v; // overflow
 
-    t_addr pc; // program counter
-    char sp; // stack pointer
-    char ra; // accumulator
-    char rx; // x
-    char ry; // y
-    char rp; // processor status
+    // everything above but the cartridge, what a console is saved and
+    // loaded as. the ram and its changes lead, so they can be found in a
+    // saved state
+    template <typename t_archive>
+    void transfer(t_archive& ar) {
+        ar(ram, ram_changes, ram_hash);
+        ar(reset_flag, nmi_flag, irq_flag, ready, arg, r_cyc, w_cyc);
+        ar(step_count, cycle_count, bad_opcode_count);
+        ar(pc, sp, ra, rx, ry, rp, flag_n, flag_z, flag_c, flag_v);
+    }
 
     // addresses
 
@@ -44,6 +73,9 @@ namespace {
     const t_addr addr_rp = 0x10003;
     const t_addr addr_sp = 0x10004;
 
+    // most cycles an idle loop is fast-forwarded by in one go
+    const unsigned long idle_skip_limit = 1024;
+
     // declarations
 
     // addressing modes
@@ -149,7 +181,10 @@ namespace {
     void set_interrupt_disable_flag(bool);
     bool get_interrupt_disable_flag();
     void set_break_flag(bool);
-    bool get_break_flag();
+    char get_status();
+    void set_status(char);
+    void set_nz(char);
+    void load_register(char&, char);
     char read_mem(t_addr);
     t_addr read_mem_2(t_addr);
     void write_mem(t_addr, char);
@@ -160,6 +195,7 @@ namespace {
     void push_addr(t_addr);
     t_addr pull_addr();
     void short_jump_if(bool);
+    unsigned long skip_idle_loop();
 
     // definitions
 
@@ -178,7 +214,7 @@ namespace {
         if (nmi_flag == 1) {
             nmi_flag = 0;
             push_addr(pc);
-            auto val = rp;
+            auto val = get_status();
             set_bit(val, 5, 1);
             set_bit(val, 4, 0);
             push(val);
@@ -192,7 +228,7 @@ namespace {
         } else if (irq_flag == 1) {
             irq_flag = 0;
             push_addr(pc);
-            auto val = rp;
+            auto val = get_status();
             set_bit(val, 5, 1);
             set_bit(val, 4, 0);
             push(val);
@@ -500,17 +536,17 @@ namespace {
     }
 
     void i_lda() {
-        set_with_flags(addr_ra, read_mem(arg));
+        load_register(ra, read_mem(arg));
         cycle_count += 2 + r_cyc;
     }
 
     void i_ldx() {
-        set_with_flags(addr_rx, read_mem(arg));
+        load_register(rx, read_mem(arg));
         cycle_count += 2 + r_cyc;
     }
 
     void i_ldy() {
-        set_with_flags(addr_ry, read_mem(arg));
+        load_register(ry, read_mem(arg));
         cycle_count += 2 + r_cyc;
     }
 
@@ -530,27 +566,27 @@ namespace {
     }
 
     void i_tax() {
-        set_with_flags(addr_rx, ra);
+        load_register(rx, ra);
         cycle_count += 2;
     }
 
     void i_tay() {
-        set_with_flags(addr_ry, ra);
+        load_register(ry, ra);
         cycle_count += 2;
     }
 
     void i_txa() {
-        set_with_flags(addr_ra, rx);
+        load_register(ra, rx);
         cycle_count += 2;
     }
 
     void i_tya() {
-        set_with_flags(addr_ra, ry);
+        load_register(ra, ry);
         cycle_count += 2;
     }
 
     void i_tsx() {
-        set_with_flags(addr_rx, sp);
+        load_register(rx, sp);
         cycle_count += 2;
     }
 
@@ -565,12 +601,12 @@ namespace {
     }
 
     void i_pla() {
-        set_with_flags(addr_ra, pull());
+        load_register(ra, pull());
         cycle_count += 4;
     }
 
     void i_php() {
-        auto val = rp;
+        auto val = get_status();
         set_bit(val, 5, 1);
         set_bit(val, 4, 1);
         push(val);
@@ -578,30 +614,30 @@ namespace {
     }
 
     void i_plp() {
-        rp = pull();
+        set_status(pull());
         cycle_count += 4;
     }
 
     void i_and() {
-        set_with_flags(addr_ra, ra & read_mem(arg));
+        load_register(ra, ra & read_mem(arg));
         cycle_count += 2 + r_cyc;
     }
 
     void i_eor() {
-        set_with_flags(addr_ra, ra ^ read_mem(arg));
+        load_register(ra, ra ^ read_mem(arg));
         cycle_count += 2 + r_cyc;
     }
 
     void i_ora() {
-        set_with_flags(addr_ra, ra | read_mem(arg));
+        load_register(ra, ra | read_mem(arg));
         cycle_count += 2 + r_cyc;
     }
 
     void i_bit() {
         auto val = read_mem(arg);
-        set_zero_flag((ra & val) == 0);
-        set_overflow_flag(get_bit(val, 6));
-        set_negative_flag(get_bit(val, 7));
+        flag_z = ra & val;
+        flag_n = val;
+        flag_v = (val >> 6) & 1;
         cycle_count += 2 + r_cyc;
     };
 
@@ -616,22 +652,22 @@ namespace {
     }
 
     void i_inx() {
-        set_with_flags(addr_rx, rx + 1);
+        load_register(rx, rx + 1);
         cycle_count += 2;
     }
 
     void i_dex() {
-        set_with_flags(addr_rx, rx - 1);
+        load_register(rx, rx - 1);
         cycle_count += 2;
     }
 
     void i_iny() {
-        set_with_flags(addr_ry, ry + 1);
+        load_register(ry, ry + 1);
         cycle_count += 2;
     }
 
     void i_dey() {
-        set_with_flags(addr_ry, ry - 1);
+        load_register(ry, ry - 1);
         cycle_count += 2;
     }
 
@@ -720,7 +756,7 @@ namespace {
 
     void i_brk() {
         push_addr(pc + 1);
-        auto val = rp;
+        auto val = get_status();
         set_bit(val, 5, 1);
         set_bit(val, 4, 1);
         push(val);
@@ -731,7 +767,7 @@ namespace {
     }
 
     void i_rti() {
-        rp = pull();
+        set_status(pull());
         pc = pull_addr();
         cycle_count += 6;
     }
@@ -742,97 +778,108 @@ namespace {
 
     void i_asl() {
         auto val = read_mem(arg);
-        set_carry_flag(get_bit(val, 7));
+        flag_c = (val >> 7) & 1;
         set_with_flags(arg, val << 1);
         cycle_count += (arg == addr_ra) ? 2 : (4 + w_cyc);
     }
 
     void i_lsr() {
         auto val = read_mem(arg);
-        set_carry_flag(get_bit(val, 0));
+        flag_c = val & 1;
         set_with_flags(arg, val >> 1);
         cycle_count += (arg == addr_ra) ? 2 : (4 + w_cyc);
     }
 
     void i_rol() {
         auto val = read_mem(arg);
-        auto ca = get_carry_flag();
-        set_carry_flag(get_bit(val, 7));
-        val <<= 1;
-        set_bit(val, 0, ca);
+        auto ca = flag_c;
+        flag_c = (val >> 7) & 1;
+        val = (val << 1) | ca;
         set_with_flags(arg, val);
         cycle_count += (arg == addr_ra) ? 2 : (4 + w_cyc);
     }
 
     void i_ror() {
         auto val = read_mem(arg);
-        auto ca = get_carry_flag();
-        set_carry_flag(get_bit(val, 0));
-        val >>= 1;
-        set_bit(val, 7, ca);
+        auto ca = flag_c;
+        flag_c = val & 1;
+        val = (val >> 1) | (ca << 7);
         set_with_flags(arg, val);
         cycle_count += (arg == addr_ra) ? 2 : (4 + w_cyc);
     }
 
     void i_adc() {
-        unsigned res = ra;
-        unsigned v = read_mem(arg);
-        auto ca = get_carry_flag();
-        v += ca;
-        auto a7 = get_bit(ra, 7);
-        auto b7 = get_bit(v, 7);
-        res += v;
-        set_with_flags(addr_ra, res);
-        auto c7 = get_bit(ra, 7);
-        if (ca == 1 && v == 0x80u) {
-            set_overflow_flag(a7 == 0);
+        unsigned a = ra;
+        unsigned b = read_mem(arg);
+        unsigned res = a + b + flag_c;
+        if (get_bit(rp, 3)) {
+            // nmos decimal mode: z comes from the binary sum, n and v from
+            // the sum before the high digit is adjusted
+            flag_z = res;
+            unsigned lo = (a & 0x0f) + (b & 0x0f) + flag_c;
+            if (lo > 0x09) {
+                lo += 0x06;
+            }
+            unsigned hi = (a >> 4) + (b >> 4) + (lo > 0x0f);
+            flag_n = hi << 4;
+            flag_v = (~(a ^ b) & (a ^ (hi << 4)) & 0x80) != 0;
+            if (hi > 0x09) {
+                hi += 0x06;
+            }
+            flag_c = (hi > 0x0f);
+            ra = (hi << 4) | (lo & 0x0f);
         } else {
-            set_overflow_flag(a7 == b7 && a7 != c7);
+            flag_v = (~(a ^ b) & (a ^ res) & 0x80) != 0;
+            flag_c = (res >= 0x100u);
+            load_register(ra, res);
         }
-        set_carry_flag(res >= 0x100u);
         cycle_count += 2 + r_cyc;
     }
 
     void i_sbc() {
-        unsigned res = ra;
-        unsigned xx = read_mem(arg);
-        auto nc = !get_carry_flag();
-        xx += nc;
-        auto a7 = get_bit(ra, 7);
-        auto b7 = get_bit(xx, 7);
-        res -= xx;
-        set_with_flags(addr_ra, res);
-        auto c7 = get_bit(ra, 7);
-        if (nc == 1 && xx == 0x80u) {
-            set_overflow_flag(a7 == 1);
+        unsigned a = ra;
+        unsigned b = read_mem(arg);
+        unsigned borrow = !flag_c;
+        unsigned res = a - b - borrow;
+        flag_v = ((a ^ b) & (a ^ res) & 0x80) != 0;
+        flag_c = (res < 0x100u);
+        if (get_bit(rp, 3)) {
+            // nmos decimal mode: the flags are those of the binary result
+            set_nz(res);
+            unsigned lo = (a & 0x0f) - (b & 0x0f) - borrow;
+            unsigned hi = (a >> 4) - (b >> 4);
+            if (lo & 0x10) {
+                lo -= 0x06;
+                hi--;
+            }
+            if (hi & 0x10) {
+                hi -= 0x06;
+            }
+            ra = (hi << 4) | (lo & 0x0f);
         } else {
-            set_overflow_flag(a7 != b7 && b7 == c7);
+            load_register(ra, res);
         }
-        set_carry_flag(res < 0x100);
         cycle_count += 2 + r_cyc;
     }
 
     void i_cmp() {
         auto val = read_mem(arg);
-        set_carry_flag(ra >= val);
-        set_zero_flag(ra == val);
-        set_negative_flag(get_bit(ra - val, 7));
+        flag_c = (ra >= val);
+        set_nz(ra - val);
         cycle_count += 2 + r_cyc;
     }
 
     void i_cpx() {
         auto val = read_mem(arg);
-        set_carry_flag(rx >= val);
-        set_zero_flag(rx == val);
-        set_negative_flag(get_bit(rx - val, 7));
+        flag_c = (rx >= val);
+        set_nz(rx - val);
         cycle_count += 2 + r_cyc;
     }
 
     void i_cpy() {
         auto val = read_mem(arg);
-        set_carry_flag(ry >= val);
-        set_zero_flag(ry == val);
-        set_negative_flag(get_bit(ry - val, 7));
+        flag_c = (ry >= val);
+        set_nz(ry - val);
         cycle_count += 2 + r_cyc;
     }
 
@@ -842,37 +889,71 @@ namespace {
         cycle_count = 4 + w_cyc;
     }
 
+    // the 6507 has 13 address lines. a12 selects the cartridge, and below
+    // it a7 the riot, whose ram is told from its i/o by a9. the tia and the
+    // riot i/o see their mirrors as the addresses they are known by
+    const t_addr addr_mask = 0x1fff;
+
+    std::uint64_t get_ram_term(unsigned i, char val) {
+        return mix_word((std::uint64_t(i) << 8) | std::uint8_t(val));
+    }
+
+    bool is_rom(t_addr addr) {
+        return (addr & 0x1000) != 0;
+    }
+
+    bool is_tia(t_addr addr) {
+        return (addr & 0x1080) == 0;
+    }
+
+    bool is_ram(t_addr addr) {
+        return (addr & 0x1280) == 0x0080;
+    }
+
     char read_mem(t_addr addr) {
-        if (addr < 0x80u) {
-            return gfx::get(addr);
-        } else if (addr >= 0x0200 && addr < 0x0300) {
-            return pia::get(addr);
+        switch (addr) {
+        case addr_ra: return ra;
+        case addr_rx: return rx;
+        case addr_ry: return ry;
+        case addr_rp: return get_status();
+        case addr_sp: return sp;
+        }
+
+        addr &= addr_mask;
+        if (is_rom(addr)) {
+            return rom_data[addr & rom_mask];
+        } else if (is_ram(addr)) {
+            return ram[addr & (machine::ram_size - 1)];
+        } else if (is_tia(addr)) {
+            return gfx::get(addr & 0x7f);
         } else {
-            switch (addr) {
-            case addr_ra: return ra; break;
-            case addr_rx: return rx; break;
-            case addr_ry: return ry; break;
-            case addr_rp: return rp; break;
-            case addr_sp: return sp; break;
-            default: return memory[addr]; break;
-            }
+            return pia::get(addr & 0x2ff);
         }
     }
 
     void write_mem(t_addr addr, char val) {
-        if (addr < 0x80u) {
-            gfx::set_with_delay(addr, val);
-        } else if (addr >= 0x0200 && addr < 0x0300) {
-            pia::set(addr, val);
-        } else {
-            switch (addr) {
-            case addr_ra: ra = val; break;
-            case addr_rx: rx = val; break;
-            case addr_ry: ry = val; break;
-            case addr_rp: rp = val; break;
-            case addr_sp: sp = val; break;
-            default: memory[addr] = val; break;
+        switch (addr) {
+        case addr_ra: ra = val; return;
+        case addr_rx: rx = val; return;
+        case addr_ry: ry = val; return;
+        case addr_rp: set_status(val); return;
+        case addr_sp: sp = val; return;
+        }
+
+        addr &= addr_mask;
+        if (is_rom(addr)) {
+            return;
+        } else if (is_ram(addr)) {
+            auto i = addr & (machine::ram_size - 1);
+            if (ram[i] != val) {
+                ram_changes[i / 8] |= 1 << (i % 8);
+                ram_hash += get_ram_term(i, val) - get_ram_term(i, ram[i]);
+                ram[i] = val;
             }
+        } else if (is_tia(addr)) {
+            gfx::set_with_delay(addr & 0x7f, val);
+        } else {
+            pia::set(addr & 0x2ff, val);
         }
     }
 
@@ -884,8 +965,17 @@ namespace {
 
     void set_with_flags(t_addr addr, char v) {
         write_mem(addr, v);
-        set_zero_flag(v == 0);
-        set_negative_flag(get_bit(v, 7));
+        set_nz(v);
+    }
+
+    void load_register(char& reg, char v) {
+        reg = v;
+        set_nz(v);
+    }
+
+    void set_nz(char v) {
+        flag_n = v;
+        flag_z = v;
     }
 
     void push(char val) {
@@ -928,25 +1018,95 @@ namespace {
         }
     }
 
+    // a load of a register that only the tia or the riot timer can change,
+    // followed by a branch back to that load. the loop has no effect until
+    // the branch falls through, so whole iterations are skipped by clocking
+    // the other chips forward. returns the cycles skipped
+    unsigned long skip_idle_loop() {
+        if (nmi_flag || reset_flag || irq_flag || gfx::is_write_pending()) {
+            return 0;
+        }
+
+        t_addr addr;
+        unsigned len;
+        unsigned long cycles;
+        auto opcode = read_mem(pc);
+        switch (opcode) {
+        case 0xa5: case 0x24:
+            addr = read_mem(pc + 1);
+            len = 2;
+            cycles = 3;
+            break;
+        case 0xad: case 0x2c:
+            addr = read_mem_2(pc + 1);
+            len = 3;
+            cycles = 4;
+            break;
+        default:
+            return 0;
+        }
+        if (addr >= 0x08 && addr != 0x284) {
+            return 0;
+        }
+
+        auto branch = read_mem(pc + len);
+        auto offset = read_mem(pc + len + 1);
+        if (offset != char(0x100 - len - 2)) {
+            return 0;
+        }
+        cycles += 3;
+        if (((pc + len + 2) >> 8) != (pc >> 8)) {
+            cycles++;
+        }
+
+        auto taken = [&](char val) {
+            auto z = (val == 0);
+            bool n = (val >> 7) & 1;
+            auto v = flag_v;
+            if (opcode == 0x24 || opcode == 0x2c) {
+                z = ((ra & val) == 0);
+                v = ((val >> 6) & 1) != 0;
+            }
+            switch (branch) {
+            case 0xd0: return z == false;
+            case 0xf0: return z;
+            case 0x10: return n == false;
+            case 0x30: return n;
+            case 0x50: return v == false;
+            case 0x70: return v;
+            default: return false;
+            }
+        };
+
+        unsigned long skipped = 0;
+        while (skipped < idle_skip_limit && taken(read_mem(addr))) {
+            pia::advance(cycles);
+            gfx::advance(3 * cycles);
+            step_count += 2;
+            skipped += cycles;
+        }
+        return skipped;
+    }
+
     void set_arg(t_addr addr, int n) {
         arg = addr;
         pc += n;
     }
 
     void set_carry_flag(bool x) {
-        set_bit(rp, 0, x);
+        flag_c = x;
     }
 
     bool get_carry_flag() {
-        return get_bit(rp, 0);
+        return flag_c;
     }
 
     void set_zero_flag(bool x) {
-        set_bit(rp, 1, x);
+        flag_z = !x;
     }
 
     bool get_zero_flag() {
-        return get_bit(rp, 1);
+        return flag_z == 0;
     }
 
     void set_interrupt_disable_flag(bool x) {
@@ -958,19 +1118,19 @@ namespace {
     }
 
     void set_overflow_flag(bool x) {
-        set_bit(rp, 6, x);
+        flag_v = x;
     }
 
     bool get_overflow_flag() {
-        return get_bit(rp, 6);
+        return flag_v;
     }
 
     void set_negative_flag(bool x) {
-        set_bit(rp, 7, x);
+        flag_n = x << 7;
     }
 
     bool get_negative_flag() {
-        return get_bit(rp, 7);
+        return (flag_n >> 7) & 1;
     }
 
     void set_break_flag(bool x) {
@@ -980,6 +1140,23 @@ namespace {
     bool get_break_flag() {
         return get_bit(rp, 4);
     }
+
+    char get_status() {
+        auto val = rp;
+        set_bit(val, 0, get_carry_flag());
+        set_bit(val, 1, get_zero_flag());
+        set_bit(val, 6, get_overflow_flag());
+        set_bit(val, 7, get_negative_flag());
+        return val;
+    }
+
+    void set_status(char val) {
+        rp = val;
+        set_carry_flag(get_bit(val, 0));
+        set_zero_flag(get_bit(val, 1));
+        set_overflow_flag(get_bit(val, 6));
+        set_negative_flag(get_bit(val, 7));
+    }
 }
 
 t_addr machine::get_program_counter() {
@@ -990,32 +1167,44 @@ void machine::set_program_counter(t_addr addr) {
     pc = addr;
 }
 
-int machine::load_program_from_file(const std::string& file, t_addr addr) {
-    std::ifstream input(file, std::ios::binary);
-    if (!input.good()) {
-        return -1;
-    }
-    pc = addr;
-    input.read(&memory[pc], memory.size() - pc);
-    return 0;
-}
-
-void machine::load_program(const std::vector<char>& v, t_addr addr) {
-    pc = addr;
-    std::copy(v.begin(), v.end(), memory.begin() + pc);
+// the cartridge is only pointed to, and has to outlive its use here
+void machine::set_rom(const t_rom& rom) {
+    rom_data = rom.get_data();
+    rom_mask = rom.get_mask();
 }
 
 char machine::read_memory(t_addr addr) {
     return read_mem(addr);
 }
 
+// the ram as it is, without going through the bus
+const char* machine::get_ram() {
+    return ram.data();
+}
+
+const std::uint8_t* machine::get_ram_changes() {
+    return ram_changes.data();
+}
+
+void machine::clear_ram_changes() {
+    ram_changes.fill(0);
+}
+
+std::size_t machine::get_saved_ram_offset() {
+    return 0;
+}
+
+std::size_t machine::get_saved_ram_changes_offset() {
+    return sizeof(ram);
+}
+
 void machine::print_info() {
     std::cout << "| a : "; print_hex(ra);
     std::cout << " | x : "; print_hex(rx);
     std::cout << " | y : "; print_hex(ry);
     std::cout << " | sp : "; print_hex(sp);
     std::cout << " | pc : "; print_hex(pc);
-    std::cout << " | p : "; print_hex(rp);
+    std::cout << " | p : "; print_hex(get_status());
     std::cout << " | sc : "; print_hex(step_count);
     std::cout << " |\n";
 }
@@ -1028,14 +1217,69 @@ unsigned long machine::get_cycle_counter() {
     return cycle_count;
 }
 
-void machine::cycle() {
+// opcodes the cpu did not know and stalled on since init
+unsigned long machine::get_bad_opcode_counter() {
+    return bad_opcode_count;
+}
+
+void machine::set_step_counter(unsigned long val) {
+    step_count = val;
+}
+
+void machine::set_bad_opcode_counter(unsigned long val) {
+    bad_opcode_count = val;
+}
+
+// the cycles it took, more than one when an idle loop was skipped
+unsigned long machine::cycle() {
+    unsigned long skipped = 0;
     if (cycle_count == 0) {
         if (ready == false) {
-            return;
+            return 1;
+        }
+        skipped = skip_idle_loop();
+        if (step() < 0) {
+            bad_opcode_count++;
         }
-        step();
     }
     cycle_count--;
+    return 1 + skipped;
+}
+
+// everything that decides what the cpu does next : registers, ram, which
+// holds the stack as well, pending interrupts, and where it is within an
+// instruction. the ram goes in by the sum its writes keep. the operand and
+// its cycles are left out, as an instruction is done with them as soon as
+// it starts
+std::uint64_t machine::hash_state(std::uint64_t h) {
+    h = hash_word(h, ram_hash);
+    h = hash_word(h, pc | std::uint64_t(std::uint8_t(sp)) << 32 |
+                  std::uint64_t(std::uint8_t(ra)) << 40 |
+                  std::uint64_t(std::uint8_t(rx)) << 48 |
+                  std::uint64_t(std::uint8_t(ry)) << 56);
+    h = hash_word(h, std::uint8_t(get_status()) | std::uint64_t(ready) << 8 |
+                  std::uint64_t(reset_flag) << 16 |
+                  std::uint64_t(nmi_flag) << 24 |
+                  std::uint64_t(irq_flag) << 32);
+    return hash_word(h, cycle_count);
+}
+
+std::size_t machine::get_state_size() {
+    t_state_size ar;
+    transfer(ar);
+    return ar.get();
+}
+
+char* machine::save_state(char* out) {
+    t_state_saver ar(out);
+    transfer(ar);
+    return ar.get();
+}
+
+const char* machine::load_state(const char* in) {
+    t_state_loader ar(in);
+    transfer(ar);
+    return ar.get();
 }
 
 void machine::halt() {
@@ -1056,12 +1300,18 @@ void machine::init() {
     ra = 0x00;
     rx = 0x00;
     ry = 0x00;
-    rp = 0x24;
-    std::fill(memory.begin(), memory.end(), 0x00);
+    set_status(0x24);
+    ram.fill(0x00);
+    ram_changes.fill(0);
+    ram_hash = 0;
+    for (unsigned i = 0; i < ram_size; i++) {
+        ram_hash += get_ram_term(i, ram[i]);
+    }
     nmi_flag = 0;
     irq_flag = 0;
     reset_flag = 0;
     step_count = 0;
     cycle_count = 0;
+    bad_opcode_count = 0;
     ready = true;
 }
@@ -1,23 +1,40 @@
 #pragma once
 
+#include <cstddef>
 #include <array>
-#include <vector>
+#include <cstdint>
 
 using t_addr = unsigned long;
 
+class t_rom;
+
 namespace machine {
+    // the 128 bytes of the riot, at 0x80 and mirrored at 0x180 for the stack
+    const unsigned ram_size = 0x80;
+
     void init();
     void set_program_counter(t_addr);
     t_addr get_program_counter();
     unsigned long get_step_counter();
     unsigned long get_cycle_counter();
+    unsigned long get_bad_opcode_counter();
+    void set_step_counter(unsigned long);
+    void set_bad_opcode_counter(unsigned long);
     void print_info();
     char read_memory(t_addr);
-    void load_program(const std::vector<char>&, t_addr);
-    int load_program_from_file(const std::string&, t_addr);
+    const char* get_ram();
+    const std::uint8_t* get_ram_changes();
+    void clear_ram_changes();
+    std::size_t get_saved_ram_offset();
+    std::size_t get_saved_ram_changes_offset();
+    void set_rom(const t_rom&);
     void reset();
-    void cycle();
+    unsigned long cycle();
     void halt();
     bool is_halted();
     void resume();
+    std::uint64_t hash_state(std::uint64_t);
+    std::size_t get_state_size();
+    char* save_state(char*);
+    const char* load_state(const char*);
 }
@@ -1,44 +1,208 @@
 #include <iostream>
 #include <chrono>
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
 #include <cstdio>
+#include <future>
 
+#include "console.hpp"
+#include "farm.hpp"
 #include "gfx.hpp"
-#include "pia.hpp"
-#include "machine.hpp"
+#include "audio.hpp"
+#include "scale.hpp"
+#include "ntsc.hpp"
+#include "palette.hpp"
+#include "frame.hpp"
+#include "record.hpp"
+#include "sdl.hpp"
+#include "verify.hpp"
+#include "input.hpp"
 
+// frames each rom of a farm runs for unless told otherwise, ten seconds
+const auto farm_frames = 600l;
+
+namespace {
+    std::atomic<bool> running;
+    bool headless = false;
+    long frame_limit = 0;
+    unsigned threads = 0;
+    unsigned interleave = 1;
+    bool isolate = false;
+    std::string farm_path;
+    std::string record_path;
+    std::string hash_path;
+    bool hash_frames = true;
+    std::string check_path;
+    std::string input_path;
+    bool verified;
+
+    // the state of the console belongs to the thread that runs it, so it is
+    // set up there as well
+    bool load(const std::string& rom, unsigned long fps) {
+        if (console::init(rom) == false) {
+            std::cout << "could not load file\n";
+            return false;
+        }
+        frame::set_frames_per_second(fps);
+        if (input_path.empty() == false && input::load_script(input_path) == false) {
+            return false;
+        }
+        if (hash_path.empty() == false && verify::open_output(hash_path, hash_frames) == false) {
+            return false;
+        }
+        if (check_path.empty() == false && verify::open_expected(check_path) == false) {
+            return false;
+        }
+        return true;
+    }
+
+    // runs on its own thread, so that presenting a frame or waiting for the
+    // display never holds up the emulation. it waits for the frontend to be
+    // ready once the rom is loaded
+    void emulate(const std::string& rom, unsigned long fps,
+                 std::promise<bool> loaded, std::future<bool> start) {
+        auto ok = load(rom, fps);
+        loaded.set_value(ok);
+        if (ok == false || start.get() == false) {
+            verify::close();
+            return;
+        }
+        frame::set_presenting(headless == false);
+        while (running) {
+            if (gfx::is_waiting()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (console::run_frame() == false && headless) {
+                std::cerr << "no frame after " << frame::get_count() <<
+                    " frames\n";
+                break;
+            }
+            if (frame::get_count() == frame_limit || verify::has_failed()) {
+                break;
+            }
+        }
+        running = false;
+        verified = verify::close();
+    }
+
+    bool set_option(const std::string& name, const std::string& val) {
+        if (name == "--scale") {
+            scale::set_factor(std::stoul(val));
+        } else if (name == "--aspect") {
+            scale::set_aspect(std::stod(val));
+        } else if (name == "--scanlines") {
+            scale::set_scanlines(std::stoul(val));
+        } else if (name == "--phosphor") {
+            scale::set_phosphor(std::stoul(val));
+        } else if (name == "--filter" && (val == "ntsc" || val == "none")) {
+            ntsc::set_enabled(val == "ntsc");
+        } else if (name == "--palette") {
+            palette::select(val);
+        } else if (name == "--farm") {
+            farm_path = val;
+        } else if (name == "--threads") {
+            threads = std::stoul(val);
+        } else if (name == "--interleave") {
+            interleave = std::stoul(val);
+        } else if (name == "--frames") {
+            frame_limit = std::stol(val);
+        } else if (name == "--hash") {
+            hash_path = val;
+        } else if (name == "--hash-format" && (val == "frames" || val == "states")) {
+            hash_frames = (val == "frames");
+        } else if (name == "--check") {
+            check_path = val;
+        } else if (name == "--input") {
+            input_path = val;
+        } else if (name == "--record") {
+            record_path = val;
+        } else if (name == "--record-format") {
+            return record::set_format(val);
+        } else if (name == "--record-size" && (val == "native" || val == "window")) {
+            record::set_native(val == "native");
+        } else {
+            return false;
+        }
+        return true;
+    }
+}
+
+// usage : program rom [fps [latency_ms]] [--headless] [--option value]...
+//         program --farm dir|manifest [--threads n] [--frames n]
+//                 [--interleave n | --isolate]
 int main(int argc, char** argv) {
-    if (argc < 2 || argc >= 4) {
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            args.push_back(arg);
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--isolate") {
+            isolate = true;
+        } else if (i + 1 >= argc || set_option(arg, argv[i + 1]) == false) {
+            std::cout << "invalid option " << arg << "\n";
+            return 1;
+        } else {
+            i++;
+        }
+    }
+
+    if (farm_path.empty() == false) {
+        std::vector<std::string> roms;
+        if (args.empty() == false || farm::list_roms(farm_path, roms) == false) {
+            std::cout << "invalid arguments\n";
+            return 1;
+        }
+        auto frames = (frame_limit != 0) ? frame_limit : farm_frames;
+        return farm::run(roms, threads, frames, interleave, isolate) ? 0 : 1;
+    }
+
+    if (args.size() < 1 || args.size() > 3) {
         std::cout << "invalid arguments\n";
         return 1;
     }
     unsigned long fps = 60;
-    if (argc == 3) {
-        fps = std::stoul(argv[2]);
+    if (args.size() >= 2) {
+        fps = std::stoul(args[1]);
+    }
+    unsigned long latency = 30;
+    if (args.size() >= 3) {
+        latency = std::stoul(args[2]);
     }
+    audio::set_latency(latency);
 
-    machine::init();
+    std::promise<bool> loaded;
+    auto load_ok = loaded.get_future();
+    std::promise<bool> start;
+    running = true;
+    std::thread emulation(emulate, args[0], fps, std::move(loaded),
+                          start.get_future());
 
-    auto ret = machine::load_program_from_file(argv[1], 0xf000);
-    if (ret < 0) {
-        std::cout << "could not load file\n";
-        return 1;
+    auto ok = load_ok.get();
+    auto windowed = false;
+    if (ok && headless == false) {
+        ok = windowed = sdl::init();
     }
+    if (ok && record_path.empty() == false) {
+        ok = palette::init() && record::open(record_path, fps);
+    }
+    start.set_value(ok);
 
-    pia::init();
-    gfx::init();
-    gfx::set_frames_per_second(fps);
-    while (gfx::is_running()) {
-        gfx::poll();
-
-        if (gfx::is_waiting() == false) {
-            gfx::cycle();
-            gfx::cycle();
-            gfx::cycle();
-            machine::cycle();
-            pia::cycle();
+    if (windowed) {
+        while (running && sdl::is_running()) {
+            sdl::poll();
+            sdl::present();
         }
+        running = false;
     }
-
-    gfx::close();
+    emulation.join();
+    if (windowed) {
+        sdl::close();
+    }
+    auto recorded = record::close();
+    return (ok && verified && recorded) ? 0 : 1;
 }
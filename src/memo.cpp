@@ -0,0 +1,89 @@
+#include <cstring>
+
+#include "memo.hpp"
+
+namespace {
+    // what an entry takes besides its data : the list node, the index node,
+    // the shared block holding the data's vector and the heap headers of
+    // all of them, about
+    const std::size_t entry_overhead = 128;
+}
+
+t_memo::t_memo() : budget(0), used(0), hits(0), misses(0), evictions(0) {
+}
+
+// down to size bytes, from the back of the list, where the entries looked
+// at least recently are
+void t_memo::evict(std::size_t size) {
+    while (used > size) {
+        auto& entry = entries.back();
+        used -= entry.data->size() + entry_overhead;
+        index.erase(entry.key);
+        entries.pop_back();
+        evictions++;
+    }
+}
+
+// 0 turns the memo off, and anything over the budget is dropped at once
+void t_memo::set_budget(std::size_t size) {
+    std::lock_guard<std::mutex> guard(lock);
+    budget = size;
+    evict(budget);
+}
+
+std::size_t t_memo::get_budget() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return budget;
+}
+
+// for when what a step does changes, which the keys do not show
+void t_memo::clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    entries.clear();
+    index.clear();
+    used = 0;
+}
+
+// copies the data of the entry out, as it may be evicted by another thread
+// right after. the copy is made outside of the lock, from a reference that
+// keeps the data alive through an eviction. an entry of another size is a
+// miss
+bool t_memo::find(std::uint64_t key, char* out, std::size_t size) {
+    t_data data;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = index.find(key);
+        if (it == index.end() || it->second->data->size() != size) {
+            misses++;
+            return false;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        data = it->second->data;
+        hits++;
+    }
+    std::memcpy(out, data->data(), size);
+    return true;
+}
+
+// the data is copied before taking the lock. a key another thread added in
+// the meantime is left as it is, as both came from the same state
+void t_memo::add(std::uint64_t key, const char* data, std::size_t size) {
+    if (size + entry_overhead > get_budget()) {
+        return;
+    }
+    auto copy = std::make_shared<const std::vector<char>>(data, data + size);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (size + entry_overhead > budget || index.count(key) != 0) {
+        return;
+    }
+    evict(budget - size - entry_overhead);
+    entries.push_front({key, std::move(copy)});
+    index[key] = entries.begin();
+    used += size + entry_overhead;
+}
+
+t_memo::t_stats t_memo::get_stats() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return {hits, misses, evictions, entries.size(), used};
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// what came out of a step from a state, by the hash of that state, for the
+// step to be looked up the next time it is taken from there. the entries
+// are kept within a budget of bytes, the one used longest ago going first.
+// any thread can look up and add. the data of an entry is shared, so that
+// it can be copied out after letting go of the lock
+class t_memo {
+    using t_data = std::shared_ptr<const std::vector<char>>;
+
+    struct t_entry {
+        std::uint64_t key;
+        t_data data;
+    };
+
+    std::size_t budget;
+    std::size_t used;
+    std::list<t_entry> entries;
+    std::unordered_map<std::uint64_t, std::list<t_entry>::iterator> index;
+
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    mutable std::mutex lock;
+
+    void evict(std::size_t);
+
+public:
+    struct t_stats {
+        unsigned long hits;
+        unsigned long misses;
+        unsigned long evictions;
+        std::size_t entries;
+        std::size_t used;
+    };
+
+    t_memo();
+
+    void set_budget(std::size_t);
+    std::size_t get_budget() const;
+    void clear();
+    bool find(std::uint64_t, char*, std::size_t);
+    void add(std::uint64_t, const char*, std::size_t);
+    t_stats get_stats() const;
+};
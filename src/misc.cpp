@@ -3,6 +3,15 @@
 
 #include "misc.hpp"
 
+std::uint64_t hash_bytes(std::uint64_t h, const void* data, std::size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+        h ^= bytes[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
 bool get_bit(char x, int n) {
     return x & (1u << n);
 }
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 class t_millisecond_timer {
     std::chrono::time_point<std::chrono::steady_clock> t0;
@@ -16,6 +20,88 @@ public:
     }
 };
 
+// fnv-1a, chained through the first argument
+const std::uint64_t hash_seed = 0xcbf29ce484222325;
+std::uint64_t hash_bytes(std::uint64_t, const void*, std::size_t);
+
+// the finalizer of splitmix64, which spreads every bit of a word over all
+// of them
+inline std::uint64_t mix_word(std::uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+// a chain of whole words rather than bytes, for the console state. one
+// multiply a word keeps the chain short, and a mix_word at its end makes up
+// for how little each step mixes
+inline std::uint64_t hash_word(std::uint64_t h, std::uint64_t val) {
+    h = (h ^ val) * 0x9e3779b97f4a7c15;
+    return h ^ (h >> 32);
+}
+
+// a module lists the variables of its state once, as the arguments of a
+// call to one of these, to measure the state, save it to a flat buffer or
+// load it back. the variables are plain values, copied as bytes
+class t_state_size {
+    std::size_t size = 0;
+public:
+    template <typename... t_vals>
+    void operator()(const t_vals&... vals) {
+        using expand = int[];
+        (void)expand{0, (size += sizeof(vals), 0)...};
+    }
+    std::size_t get() const {
+        return size;
+    }
+};
+
+class t_state_saver {
+    char* out;
+
+    template <typename t_val>
+    void copy(const t_val& val) {
+        static_assert(std::is_trivially_copyable<t_val>::value, "not plain");
+        std::memcpy(out, &val, sizeof(val));
+        out += sizeof(val);
+    }
+
+public:
+    explicit t_state_saver(char* p) : out(p) {}
+
+    template <typename... t_vals>
+    void operator()(const t_vals&... vals) {
+        using expand = int[];
+        (void)expand{0, (copy(vals), 0)...};
+    }
+    char* get() const {
+        return out;
+    }
+};
+
+class t_state_loader {
+    const char* in;
+
+    template <typename t_val>
+    void copy(t_val& val) {
+        static_assert(std::is_trivially_copyable<t_val>::value, "not plain");
+        std::memcpy(&val, in, sizeof(val));
+        in += sizeof(val);
+    }
+
+public:
+    explicit t_state_loader(const char* p) : in(p) {}
+
+    template <typename... t_vals>
+    void operator()(t_vals&... vals) {
+        using expand = int[];
+        (void)expand{0, (copy(vals), 0)...};
+    }
+    const char* get() const {
+        return in;
+    }
+};
+
 bool get_bit(char, int);
 void set_bit(char&, int, bool);
 void print_hex(char);
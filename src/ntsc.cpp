@@ -0,0 +1,186 @@
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NTSC_X86
+#endif
+
+#include "ntsc.hpp"
+
+// the pixel clock is the subcarrier frequency, so a pixel is exactly one
+// cycle and its samples always sit at the same phases
+const auto samples_per_pixel = 4u;
+
+// pixels on either side that reach into the decoded samples of a pixel
+const auto reach = 2u;
+const auto taps = 2 * reach + 1;
+
+// fractional bits of the kernels
+const auto kernel_shift = 5;
+
+const auto palette_size = 0x80u;
+
+namespace {
+    // what a pixel of one colour adds to the 4 output samples of the pixel
+    // at some distance, as b, g, r, a per sample, the way the output lies
+    // in memory
+    struct alignas(32) t_tap {
+        std::int16_t val[samples_per_pixel * 4];
+    };
+
+    std::array<std::array<t_tap, taps>, palette_size> kernels;
+    bool enabled;
+
+    // one row of palette indices with black on both ends
+    std::array<char, frame::width + 2 * reach> row;
+
+    // where the carrier is at each sample of a pixel
+    const double carrier_cos[samples_per_pixel] = {1, 0, -1, 0};
+    const double carrier_sin[samples_per_pixel] = {0, 1, 0, -1};
+
+    // luma low pass, with a zero at the subcarrier
+    double luma_filter(int m) {
+        const double h[] = {1, 2, 2, 2, 1};
+        return (std::abs(m) > 2) ? 0 : h[m + 2] / 8;
+    }
+
+    // chroma low pass, with zeros at the subcarrier and twice it, so that
+    // neither luma nor the demodulation leave anything behind on flat areas
+    double chroma_filter(int m) {
+        const double h[] = {1, 4, 10, 18, 25, 28, 25, 18, 10, 4, 1};
+        return (std::abs(m) > 5) ? 0 : h[m + 5] / 144;
+    }
+
+    void run_scalar(std::uint32_t* out) {
+        for (unsigned x = 0; x < frame::width; x++) {
+            int acc[samples_per_pixel * 4] = {};
+            for (unsigned d = 0; d < taps; d++) {
+                auto& tap = kernels[row[x + d] >> 1][d];
+                for (unsigned i = 0; i < samples_per_pixel * 4; i++) {
+                    acc[i] += tap.val[i];
+                }
+            }
+            for (unsigned k = 0; k < samples_per_pixel; k++) {
+                std::uint32_t res = 0;
+                for (unsigned c = 0; c < 4; c++) {
+                    auto v = acc[4 * k + c] >> kernel_shift;
+                    res |= std::uint32_t(std::max(0, std::min(0xff, v))) << 8 * c;
+                }
+                out[samples_per_pixel * x + k] = res;
+            }
+        }
+    }
+
+#ifdef NTSC_X86
+    __attribute__((target("sse2")))
+    void run_sse2(std::uint32_t* out) {
+        for (unsigned x = 0; x < frame::width; x++) {
+            auto lo = _mm_setzero_si128();
+            auto hi = _mm_setzero_si128();
+            for (unsigned d = 0; d < taps; d++) {
+                auto val = kernels[row[x + d] >> 1][d].val;
+                lo = _mm_adds_epi16(lo, _mm_load_si128((const __m128i*)val));
+                hi = _mm_adds_epi16(hi, _mm_load_si128((const __m128i*)(val + 8)));
+            }
+            lo = _mm_srai_epi16(lo, kernel_shift);
+            hi = _mm_srai_epi16(hi, kernel_shift);
+            auto dst = (__m128i*)(out + samples_per_pixel * x);
+            _mm_storeu_si128(dst, _mm_packus_epi16(lo, hi));
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void run_avx2(std::uint32_t* out) {
+        for (unsigned x = 0; x < frame::width; x++) {
+            auto acc = _mm256_setzero_si256();
+            for (unsigned d = 0; d < taps; d++) {
+                auto val = kernels[row[x + d] >> 1][d].val;
+                acc = _mm256_adds_epi16(acc, _mm256_load_si256((const __m256i*)val));
+            }
+            acc = _mm256_srai_epi16(acc, kernel_shift);
+            // the pack works per 128-bit lane, so the samples 0 1 end up in
+            // the low quadword and 2 3 in the third one
+            acc = _mm256_packus_epi16(acc, acc);
+            acc = _mm256_permute4x64_epi64(acc, 0x08);
+            auto dst = (__m128i*)(out + samples_per_pixel * x);
+            _mm_storeu_si128(dst, _mm256_castsi256_si128(acc));
+        }
+    }
+#endif
+
+    void (*run_row)(std::uint32_t*) = run_scalar;
+}
+
+// works out the kernels of all colours of the palette
+void ntsc::init(const char (*palette)[3]) {
+    for (unsigned e = 0; e < palette_size; e++) {
+        double r = palette[e][0];
+        double g = palette[e][1];
+        double b = palette[e][2];
+        auto y = 0.299 * r + 0.587 * g + 0.114 * b;
+        auto i = 0.596 * r - 0.274 * g - 0.322 * b;
+        auto q = 0.211 * r - 0.523 * g + 0.312 * b;
+
+        double signal[samples_per_pixel];
+        for (unsigned j = 0; j < samples_per_pixel; j++) {
+            signal[j] = y + i * carrier_cos[j] + q * carrier_sin[j];
+        }
+
+        for (unsigned d = 0; d < taps; d++) {
+            auto& tap = kernels[e][d];
+            for (unsigned k = 0; k < samples_per_pixel; k++) {
+                double dy = 0;
+                double di = 0;
+                double dq = 0;
+                for (unsigned j = 0; j < samples_per_pixel; j++) {
+                    int m = int(samples_per_pixel * d + j) -
+                        int(samples_per_pixel * reach + k);
+                    dy += luma_filter(m) * signal[j];
+                    di += chroma_filter(m) * signal[j] * 2 * carrier_cos[j];
+                    dq += chroma_filter(m) * signal[j] * 2 * carrier_sin[j];
+                }
+                double rgb[3] = {
+                    dy + 0.956 * di + 0.621 * dq,
+                    dy - 0.272 * di - 0.647 * dq,
+                    dy - 1.106 * di + 1.703 * dq,
+                };
+                auto scale = double(1 << kernel_shift);
+                tap.val[4 * k + 0] = std::int16_t(std::lround(rgb[2] * scale));
+                tap.val[4 * k + 1] = std::int16_t(std::lround(rgb[1] * scale));
+                tap.val[4 * k + 2] = std::int16_t(std::lround(rgb[0] * scale));
+                tap.val[4 * k + 3] = (d == reach) ? 0xff << kernel_shift : 0;
+            }
+        }
+    }
+
+    std::fill(row.begin(), row.end(), 0x00);
+
+    run_row = run_scalar;
+#ifdef NTSC_X86
+    if (__builtin_cpu_supports("sse2")) {
+        run_row = run_sse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        run_row = run_avx2;
+    }
+#endif
+}
+
+void ntsc::set_enabled(bool val) {
+    enabled = val;
+}
+
+bool ntsc::is_enabled() {
+    return enabled;
+}
+
+// out has to hold width times frame::height pixels
+void ntsc::run(const frame::t_buffer& screen, std::uint32_t* out) {
+    for (unsigned j = 0; j < frame::height; j++) {
+        auto line = screen.begin() + j * frame::width;
+        std::copy(line, line + frame::width, row.begin() + reach);
+        run_row(out + j * width);
+    }
+}
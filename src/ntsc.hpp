@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+#include "frame.hpp"
+
+// runs the frame through a model of the composite video path: every pixel
+// becomes four samples of one cycle of the colour subcarrier, and is decoded
+// back with the bandwidth limits that smear colour into the neighbours
+namespace ntsc {
+    const unsigned width = frame::width * 4;
+
+    void init(const char (*)[3]);
+    void set_enabled(bool);
+    bool is_enabled();
+    void run(const frame::t_buffer&, std::uint32_t*);
+}
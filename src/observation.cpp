@@ -0,0 +1,332 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OBSERVATION_X86
+#endif
+
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+#include "observation.hpp"
+#include "palette.hpp"
+
+// bits 1 to 3 of a palette index are its luminance, whatever the palette
+const auto luminance_mask = char(0x0e);
+
+namespace {
+    // the luminance of each index in the current palette, and the same as
+    // one table of the hues for each luminance, twice for both lanes
+    std::array<std::uint8_t, 0x100> luma;
+    alignas(32) std::uint8_t luma_by_hue[8][32];
+
+    // a frame in luminance, and the rows of it one output row is made of
+    thread_local std::array<std::uint8_t, frame::width * frame::height> gray;
+    // the sum is read 4 bytes at a time by the avx2 horizontal pass
+    thread_local std::array<std::uint16_t, frame::width + 2> row_sum;
+
+    void to_gray_scalar(std::uint8_t* out, const char* in, unsigned n) {
+        for (unsigned i = 0; i < n; i++) {
+            out[i] = luma[in[i]];
+        }
+    }
+
+    void to_gray_pooled_scalar(std::uint8_t* out, const char* in,
+                               const char* prev, unsigned n) {
+        for (unsigned i = 0; i < n; i++) {
+            out[i] = std::max(luma[in[i]], luma[prev[i]]);
+        }
+    }
+
+    // sum += row * w over a whole row, which stays below 256 * 256 as long
+    // as the weights of the sum add up to 256
+    void add_row_scalar(std::uint16_t* sum, const std::uint8_t* row,
+                        unsigned n, std::uint16_t w) {
+        for (unsigned i = 0; i < n; i++) {
+            sum[i] += row[i] * w;
+        }
+    }
+    // one output row from the columns of the sum of its source rows
+    void resample_row_scalar(std::uint8_t* out, const std::uint16_t* sum,
+                             const unsigned* first,
+                             const std::uint16_t* weights, unsigned taps,
+                             unsigned stride, unsigned n) {
+        for (unsigned x = 0; x < n; x++) {
+            std::uint32_t val = 1u << 15;
+            for (unsigned k = 0; k < taps; k++) {
+                auto w = weights[k * stride + x];
+                val += std::uint32_t(sum[first[x] + k]) * w;
+            }
+            out[x] = std::min(val >> 16, 0xffu);
+        }
+    }
+
+    // out = whichever of the two is brighter, out on a tie
+    void max_pool_scalar(char* out, const char* prev, unsigned n) {
+        for (unsigned i = 0; i < n; i++) {
+            if ((prev[i] & luminance_mask) > (out[i] & luminance_mask)) {
+                out[i] = prev[i];
+            }
+        }
+    }
+
+#ifdef OBSERVATION_X86
+    __attribute__((target("sse2")))
+    void add_row_sse2(std::uint16_t* sum, const std::uint8_t* row,
+                      unsigned n, std::uint16_t w) {
+        auto zero = _mm_setzero_si128();
+        auto weight = _mm_set1_epi16(w);
+        unsigned i = 0;
+        for (; i + 16 <= n; i += 16) {
+            auto px = _mm_loadu_si128((const __m128i*)(row + i));
+            auto lo = _mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), weight);
+            auto hi = _mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), weight);
+            auto s0 = _mm_loadu_si128((const __m128i*)(sum + i));
+            auto s1 = _mm_loadu_si128((const __m128i*)(sum + i + 8));
+            _mm_storeu_si128((__m128i*)(sum + i), _mm_add_epi16(s0, lo));
+            _mm_storeu_si128((__m128i*)(sum + i + 8), _mm_add_epi16(s1, hi));
+        }
+        add_row_scalar(sum + i, row + i, n - i, w);
+    }
+
+    __attribute__((target("avx2")))
+    void add_row_avx2(std::uint16_t* sum, const std::uint8_t* row,
+                      unsigned n, std::uint16_t w) {
+        auto weight = _mm256_set1_epi16(w);
+        unsigned i = 0;
+        for (; i + 16 <= n; i += 16) {
+            auto px = _mm_loadu_si128((const __m128i*)(row + i));
+            auto prod = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(px), weight);
+            auto s = _mm256_loadu_si256((const __m256i*)(sum + i));
+            _mm256_storeu_si256((__m256i*)(sum + i), _mm256_add_epi16(s, prod));
+        }
+        add_row_scalar(sum + i, row + i, n - i, w);
+    }
+
+    // a byte shuffle looks up 16 entries, so every luminance has a table of
+    // its own indexed by the hue, and the one that matches is kept
+    __attribute__((target("avx2")))
+    __m256i lookup_luma_avx2(__m256i px, const __m256i* tables) {
+        auto hue = _mm256_and_si256(_mm256_srli_epi16(px, 4),
+                                    _mm256_set1_epi8(0x0f));
+        auto lum = _mm256_and_si256(px, _mm256_set1_epi8(luminance_mask));
+        auto res = _mm256_setzero_si256();
+        for (int l = 0; l < 8; l++) {
+            auto match = _mm256_cmpeq_epi8(lum, _mm256_set1_epi8(char(l << 1)));
+            auto val = _mm256_shuffle_epi8(tables[l], hue);
+            res = _mm256_or_si256(res, _mm256_and_si256(match, val));
+        }
+        return res;
+    }
+
+    __attribute__((target("avx2")))
+    void to_gray_avx2(std::uint8_t* out, const char* in, unsigned n) {
+        __m256i tables[8];
+        for (int l = 0; l < 8; l++) {
+            tables[l] = _mm256_load_si256((const __m256i*)luma_by_hue[l]);
+        }
+        unsigned i = 0;
+        for (; i + 32 <= n; i += 32) {
+            auto px = _mm256_loadu_si256((const __m256i*)(in + i));
+            _mm256_storeu_si256((__m256i*)(out + i),
+                                lookup_luma_avx2(px, tables));
+        }
+        to_gray_scalar(out + i, in + i, n - i);
+    }
+
+    __attribute__((target("avx2")))
+    void to_gray_pooled_avx2(std::uint8_t* out, const char* in,
+                             const char* prev, unsigned n) {
+        __m256i tables[8];
+        for (int l = 0; l < 8; l++) {
+            tables[l] = _mm256_load_si256((const __m256i*)luma_by_hue[l]);
+        }
+        unsigned i = 0;
+        for (; i + 32 <= n; i += 32) {
+            auto a = _mm256_loadu_si256((const __m256i*)(in + i));
+            auto b = _mm256_loadu_si256((const __m256i*)(prev + i));
+            auto res = _mm256_max_epu8(lookup_luma_avx2(a, tables),
+                                       lookup_luma_avx2(b, tables));
+            _mm256_storeu_si256((__m256i*)(out + i), res);
+        }
+        to_gray_pooled_scalar(out + i, in + i, prev + i, n - i);
+    }
+
+    // 8 outputs at a time, their taps gathered from the sum
+    __attribute__((target("avx2")))
+    void resample_row_avx2(std::uint8_t* out, const std::uint16_t* sum,
+                           const unsigned* first,
+                           const std::uint16_t* weights, unsigned taps,
+                           unsigned stride, unsigned n) {
+        auto low = _mm256_set1_epi32(0xffff);
+        for (unsigned x = 0; x < n; x += 8) {
+            auto index = _mm256_loadu_si256((const __m256i*)(first + x));
+            auto val = _mm256_set1_epi32(1 << 15);
+            for (unsigned k = 0; k < taps; k++) {
+                auto src = _mm256_i32gather_epi32(
+                    (const int*)sum, _mm256_add_epi32(index,
+                                                      _mm256_set1_epi32(k)), 2);
+                auto w = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+                    (const __m128i*)(weights + k * stride + x)));
+                val = _mm256_add_epi32(val, _mm256_mullo_epi32(
+                    _mm256_and_si256(src, low), w));
+            }
+            // sums over 255 only come from rounding, and saturate
+            val = _mm256_srli_epi32(val, 16);
+            auto packed = _mm_packus_epi32(_mm256_castsi256_si128(val),
+                                           _mm256_extracti128_si256(val, 1));
+            packed = _mm_packus_epi16(packed, packed);
+            alignas(8) std::uint8_t bytes[8];
+            _mm_storel_epi64((__m128i*)bytes, packed);
+            std::copy_n(bytes, std::min(n - x, 8u), out + x);
+        }
+    }
+
+    __attribute__((target("sse2")))
+    void max_pool_sse2(char* out, const char* prev, unsigned n) {
+        auto mask = _mm_set1_epi8(luminance_mask);
+        unsigned i = 0;
+        for (; i + 16 <= n; i += 16) {
+            auto a = _mm_loadu_si128((const __m128i*)(prev + i));
+            auto b = _mm_loadu_si128((const __m128i*)(out + i));
+            auto brighter = _mm_cmpgt_epi8(_mm_and_si128(a, mask),
+                                           _mm_and_si128(b, mask));
+            auto res = _mm_or_si128(_mm_and_si128(brighter, a),
+                                    _mm_andnot_si128(brighter, b));
+            _mm_storeu_si128((__m128i*)(out + i), res);
+        }
+        max_pool_scalar(out + i, prev + i, n - i);
+    }
+
+    __attribute__((target("avx2")))
+    void max_pool_avx2(char* out, const char* prev, unsigned n) {
+        auto mask = _mm256_set1_epi8(luminance_mask);
+        unsigned i = 0;
+        for (; i + 32 <= n; i += 32) {
+            auto a = _mm256_loadu_si256((const __m256i*)(prev + i));
+            auto b = _mm256_loadu_si256((const __m256i*)(out + i));
+            auto brighter = _mm256_cmpgt_epi8(_mm256_and_si256(a, mask),
+                                              _mm256_and_si256(b, mask));
+            _mm256_storeu_si256((__m256i*)(out + i),
+                                _mm256_blendv_epi8(b, a, brighter));
+        }
+        max_pool_scalar(out + i, prev + i, n - i);
+    }
+#endif
+
+    void (*max_pool_row)(char*, const char*, unsigned) = max_pool_scalar;
+    void (*add_row)(std::uint16_t*, const std::uint8_t*, unsigned,
+                    std::uint16_t) = add_row_scalar;
+    void (*resample_row)(std::uint8_t*, const std::uint16_t*, const unsigned*,
+                         const std::uint16_t*, unsigned, unsigned,
+                         unsigned) = resample_row_scalar;
+    void (*to_gray)(std::uint8_t*, const char*, unsigned) = to_gray_scalar;
+    void (*to_gray_pooled)(std::uint8_t*, const char*, const char*,
+                           unsigned) = to_gray_pooled_scalar;
+}
+
+// takes the luminance from the palette as it is loaded now
+void observation::init() {
+    auto colors = palette::get();
+    for (unsigned i = 0; i < luma.size(); i++) {
+        auto rgb = colors[i >> 1];
+        luma[i] = (299 * rgb[0] + 587 * rgb[1] + 114 * rgb[2] + 500) / 1000;
+    }
+    for (unsigned l = 0; l < 8; l++) {
+        for (unsigned h = 0; h < 32; h++) {
+            luma_by_hue[l][h] = luma[((h & 0x0f) << 4) | (l << 1)];
+        }
+    }
+
+    max_pool_row = max_pool_scalar;
+    add_row = add_row_scalar;
+    resample_row = resample_row_scalar;
+    to_gray = to_gray_scalar;
+    to_gray_pooled = to_gray_pooled_scalar;
+#ifdef OBSERVATION_X86
+    if (__builtin_cpu_supports("sse2")) {
+        max_pool_row = max_pool_sse2;
+        add_row = add_row_sse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        max_pool_row = max_pool_avx2;
+        add_row = add_row_avx2;
+        resample_row = resample_row_avx2;
+        to_gray = to_gray_avx2;
+        to_gray_pooled = to_gray_pooled_avx2;
+    }
+#endif
+}
+
+// the flicker of objects drawn every other frame is taken out by keeping
+// the brighter pixel of two frames. indices have no order of their own, so
+// this is what taking the larger value of each channel is for colours
+void observation::max_pool(const frame::t_buffer& prev, frame::t_buffer& out) {
+    max_pool_row(out.data(), prev.data(), out.size());
+}
+
+// for each of the outputs, the source pixels it overlaps. the edges between
+// them are rounded rather than the weights, so those add up to 256 exactly
+void observation::t_grayscale::t_axis::init(unsigned in, unsigned out) {
+    auto scale = double(in) / out;
+    taps = std::min(unsigned(std::ceil(scale)) + 1, in);
+    stride = (out + 7) & ~7u;
+    first.assign(stride, 0);
+    weights.assign(taps * stride, 0);
+    for (unsigned j = 0; j < out; j++) {
+        auto lo = j * scale;
+        auto hi = (j + 1) * scale;
+        auto edge = [&](double i) {
+            i = std::max(lo, std::min(hi, i));
+            return std::lround((i - lo) / scale * 256);
+        };
+        first[j] = std::min(unsigned(lo), in - taps);
+        for (unsigned k = 0; k < taps; k++) {
+            double i = first[j] + k;
+            weights[k * stride + j] = std::uint16_t(edge(i + 1) - edge(i));
+        }
+    }
+}
+
+// no larger than a frame, which is what it is without resampling
+bool observation::t_grayscale::init(unsigned w, unsigned h) {
+    if (w == 0 || h == 0 || w > frame::width || h > frame::height) {
+        return false;
+    }
+    width = w;
+    height = h;
+    columns.init(frame::width, w);
+    rows.init(frame::height, h);
+    return true;
+}
+
+unsigned observation::t_grayscale::get_size() const {
+    return width * height;
+}
+
+// the whole frame to luminance first, pooled with the one before if there
+// is one, then each output row is summed from its source rows, and its
+// pixels from the columns of that sum
+void observation::t_grayscale::run(const frame::t_buffer& screen,
+                                   const frame::t_buffer* prev,
+                                   std::uint8_t* out) const {
+    if (prev != nullptr) {
+        to_gray_pooled(gray.data(), screen.data(), prev->data(), screen.size());
+    } else {
+        to_gray(gray.data(), screen.data(), screen.size());
+    }
+
+    for (unsigned y = 0; y < height; y++) {
+        std::fill(row_sum.begin(), row_sum.end(), 0);
+        for (unsigned k = 0; k < rows.taps; k++) {
+            auto w = rows.weights[k * rows.stride + y];
+            if (w != 0) {
+                auto src = &gray[(rows.first[y] + k) * frame::width];
+                add_row(row_sum.data(), src, frame::width, w);
+            }
+        }
+        resample_row(out, row_sum.data(), columns.first.data(),
+                     columns.weights.data(), columns.taps, columns.stride,
+                     width);
+        out += width;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "frame.hpp"
+
+// what a consumer of the frames gets to see of them, made from their
+// palette indices
+namespace observation {
+    void init();
+    void max_pool(const frame::t_buffer&, frame::t_buffer&);
+
+    // luminance, area resampled to a size of its own
+    class t_grayscale {
+        // the source pixels each output pixel covers along one axis, from
+        // first on, and how much of it each of them makes up in 1/256. all
+        // have as many taps as the widest, weighted 0 where they are past.
+        // the weights go by tap, each a stride of outputs padded to 8
+        struct t_axis {
+            unsigned taps;
+            unsigned stride;
+            std::vector<unsigned> first;
+            std::vector<std::uint16_t> weights;
+
+            void init(unsigned, unsigned);
+        };
+
+        unsigned width;
+        unsigned height;
+        t_axis columns;
+        t_axis rows;
+
+    public:
+        bool init(unsigned, unsigned);
+        unsigned get_size() const;
+        void run(const frame::t_buffer&, const frame::t_buffer*,
+                 std::uint8_t*) const;
+    };
+}
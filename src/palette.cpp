@@ -0,0 +1,480 @@
+#include <array>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PALETTE_X86
+#endif
+
+#include "palette.hpp"
+
+const char ntsc_palette[0x80][3] = {
+    // 0
+    {0x00, 0x00, 0x00},
+    {0x1a, 0x1a, 0x1a},
+    {0x39, 0x39, 0x39},
+    {0x5b, 0x5b, 0x5b},
+    {0x7e, 0x7e, 0x7e},
+    {0xa2, 0xa2, 0xa2},
+    {0xc7, 0xc7, 0xc7},
+    {0xed, 0xed, 0xed},
+
+    // 1
+    {0x19, 0x02, 0x00},
+    {0x3a, 0x1f, 0x00},
+    {0x5d, 0x41, 0x00},
+    {0x82, 0x64, 0x00},
+    {0xa7, 0x88, 0x00},
+    {0xcc, 0xad, 0x00},
+    {0xf2, 0xd2, 0x19},
+    {0xfe, 0xfa, 0x40},
+
+    // 2
+    {0x37, 0x00, 0x00},
+    {0x5e, 0x08, 0x00},
+    {0x83, 0x27, 0x00},
+    {0xa9, 0x49, 0x00},
+    {0xcf, 0x6c, 0x00},
+    {0xf5, 0x8f, 0x00},
+    {0xfe, 0xb4, 0x38},
+    {0xfe, 0xdf, 0x6f},
+
+    // 3
+    {0x47, 0x00, 0x00},
+    {0x73, 0x00, 0x00},
+    {0x98, 0x13, 0x00},
+    {0xbe, 0x32, 0x16},
+    {0xe4, 0x53, 0x35},
+    {0xfe, 0x76, 0x57},
+    {0xfe, 0x9c, 0x81},
+    {0xfe, 0xc6, 0xbb},
+
+    // 4
+    {0x44, 0x00, 0x00},
+    {0x6f, 0x00, 0x1f},
+    {0x96, 0x06, 0x40},
+    {0xbb, 0x24, 0x62},
+    {0xe1, 0x45, 0x85},
+    {0xfe, 0x67, 0xaa},
+    {0xfe, 0x8c, 0xd6},
+    {0xfe, 0xb7, 0xf6},
+
+    // 5
+    {0x2d, 0x00, 0x4a},
+    {0x57, 0x00, 0x67},
+    {0x7d, 0x05, 0x8c},
+    {0xa1, 0x22, 0xb1},
+    {0xc7, 0x43, 0xd7},
+    {0xed, 0x65, 0xfe},
+    {0xfe, 0x8a, 0xf6},
+    {0xfe, 0xb5, 0xf7},
+
+    // 6
+    {0x0d, 0x00, 0x82},
+    {0x33, 0x00, 0xa2},
+    {0x55, 0x0f, 0xc9},
+    {0x78, 0x2d, 0xf0},
+    {0x9c, 0x4e, 0xfe},
+    {0xc3, 0x72, 0xfe},
+    {0xeb, 0x98, 0xfe},
+    {0xfe, 0xc0, 0xf9},
+
+    // 7
+    {0x00, 0x00, 0x91},
+    {0x0a, 0x05, 0xbd},
+    {0x28, 0x22, 0xe4},
+    {0x48, 0x42, 0xfe},
+    {0x6b, 0x64, 0xfe},
+    {0x90, 0x8a, 0xfe},
+    {0xb7, 0xb0, 0xfe},
+    {0xdf, 0xd8, 0xfe},
+
+    // 8
+    {0x00, 0x00, 0x72},
+    {0x0a, 0x1c, 0xab},
+    {0x03, 0x3c, 0xd6},
+    {0x20, 0x5e, 0xfd},
+    {0x40, 0x81, 0xfe},
+    {0x64, 0xa6, 0xfe},
+    {0x89, 0xce, 0xfe},
+    {0xb0, 0xf6, 0xfe},
+
+    // 9
+    {0x00, 0x10, 0x3a},
+    {0x00, 0x31, 0x6e},
+    {0x00, 0x55, 0xa2},
+    {0x05, 0x79, 0xc8},
+    {0x23, 0x9d, 0xee},
+    {0x44, 0xc2, 0xfe},
+    {0x68, 0xe9, 0xfe},
+    {0x8f, 0xfe, 0xfe},
+
+    // a
+    {0x00, 0x10, 0x02},
+    {0x00, 0x43, 0x26},
+    {0x00, 0x69, 0x57},
+    {0x00, 0x8d, 0x7a},
+    {0x1b, 0xb1, 0x9e},
+    {0x3b, 0xd7, 0xc3},
+    {0x5d, 0xfe, 0xe9},
+    {0x86, 0xfe, 0xfe},
+
+    // b
+    {0x00, 0x24, 0x03},
+    {0x00, 0x4a, 0x05},
+    {0x00, 0x70, 0x0c},
+    {0x09, 0x95, 0x2b},
+    {0x28, 0xba, 0x4c},
+    {0x49, 0xe0, 0x6e},
+    {0x6c, 0xfe, 0x92},
+    {0x97, 0xfe, 0xb5},
+
+    // c
+    {0x00, 0x21, 0x02},
+    {0x00, 0x46, 0x04},
+    {0x08, 0x6b, 0x00},
+    {0x28, 0x90, 0x00},
+    {0x49, 0xb5, 0x09},
+    {0x6b, 0xdb, 0x28},
+    {0x8f, 0xfe, 0x49},
+    {0xbb, 0xfe, 0x69},
+
+    // d
+    {0x00, 0x15, 0x01},
+    {0x10, 0x36, 0x00},
+    {0x30, 0x59, 0x00},
+    {0x53, 0x7e, 0x00},
+    {0x76, 0xa3, 0x00},
+    {0x9a, 0xc8, 0x00},
+    {0xbf, 0xee, 0x1e},
+    {0xe8, 0xfe, 0x3e},
+
+    // e
+    {0x1a, 0x02, 0x00},
+    {0x3b, 0x1f, 0x00},
+    {0x5e, 0x41, 0x00},
+    {0x83, 0x64, 0x00},
+    {0xa8, 0x88, 0x00},
+    {0xce, 0xad, 0x00},
+    {0xf4, 0xd2, 0x18},
+    {0xfe, 0xfa, 0x40},
+
+    // f
+    {0x38, 0x00, 0x00},
+    {0x5f, 0x08, 0x00},
+    {0x84, 0x27, 0x00},
+    {0xaa, 0x49, 0x00},
+    {0xd0, 0x6b, 0x00},
+    {0xf6, 0x8f, 0x18},
+    {0xfe, 0xb4, 0x39},
+    {0xfe, 0xdf, 0x70},
+};
+
+const char pal_palette[0x80][3] = {
+    // 0
+    {0x00, 0x00, 0x00},
+    {0x28, 0x28, 0x28},
+    {0x50, 0x50, 0x50},
+    {0x74, 0x74, 0x74},
+    {0x94, 0x94, 0x94},
+    {0xb4, 0xb4, 0xb4},
+    {0xd0, 0xd0, 0xd0},
+    {0xec, 0xec, 0xec},
+
+    // 1
+    {0x00, 0x00, 0x00},
+    {0x28, 0x28, 0x28},
+    {0x50, 0x50, 0x50},
+    {0x74, 0x74, 0x74},
+    {0x94, 0x94, 0x94},
+    {0xb4, 0xb4, 0xb4},
+    {0xd0, 0xd0, 0xd0},
+    {0xec, 0xec, 0xec},
+
+    // 2
+    {0x80, 0x58, 0x00},
+    {0x94, 0x70, 0x20},
+    {0xa8, 0x84, 0x3c},
+    {0xbc, 0x9c, 0x58},
+    {0xcc, 0xac, 0x70},
+    {0xdc, 0xc0, 0x84},
+    {0xec, 0xd0, 0x9c},
+    {0xfc, 0xe0, 0xb0},
+
+    // 3
+    {0x44, 0x5c, 0x00},
+    {0x5c, 0x78, 0x20},
+    {0x74, 0x90, 0x3c},
+    {0x8c, 0xac, 0x58},
+    {0xa0, 0xc0, 0x70},
+    {0xb0, 0xd4, 0x84},
+    {0xc4, 0xe8, 0x9c},
+    {0xd4, 0xfc, 0xb0},
+
+    // 4
+    {0x70, 0x34, 0x00},
+    {0x88, 0x50, 0x20},
+    {0xa0, 0x68, 0x3c},
+    {0xb4, 0x84, 0x58},
+    {0xc8, 0x98, 0x70},
+    {0xdc, 0xac, 0x84},
+    {0xec, 0xc0, 0x9c},
+    {0xfc, 0xd4, 0xb0},
+
+    // 5
+    {0x00, 0x64, 0x14},
+    {0x20, 0x80, 0x34},
+    {0x3c, 0x98, 0x50},
+    {0x58, 0xb0, 0x6c},
+    {0x70, 0xc4, 0x84},
+    {0x84, 0xd8, 0x9c},
+    {0x9c, 0xe8, 0xb4},
+    {0xb0, 0xfc, 0xc8},
+
+    // 6
+    {0x70, 0x00, 0x14},
+    {0x88, 0x20, 0x34},
+    {0xa0, 0x3c, 0x50},
+    {0xb4, 0x58, 0x6c},
+    {0xc8, 0x70, 0x84},
+    {0xdc, 0x84, 0x9c},
+    {0xec, 0x9c, 0xb4},
+    {0xfc, 0xb0, 0xc8},
+
+    // 7
+    {0x00, 0x5c, 0x5c},
+    {0x20, 0x74, 0x74},
+    {0x3c, 0x8c, 0x8c},
+    {0x58, 0xa4, 0xa4},
+    {0x70, 0xb8, 0xb8},
+    {0x84, 0xc8, 0xc8},
+    {0x9c, 0xdc, 0xdc},
+    {0xb0, 0xec, 0xec},
+
+    // 8
+    {0x70, 0x00, 0x5c},
+    {0x84, 0x20, 0x74},
+    {0x94, 0x3c, 0x88},
+    {0xa8, 0x58, 0x9c},
+    {0xb4, 0x70, 0xb0},
+    {0xc4, 0x84, 0xc0},
+    {0xd0, 0x9c, 0xd0},
+    {0xe0, 0xb0, 0xe0},
+
+    // 9
+    {0x00, 0x3c, 0x70},
+    {0x1c, 0x58, 0x88},
+    {0x38, 0x74, 0xa0},
+    {0x50, 0x8c, 0xb4},
+    {0x68, 0xa4, 0xc8},
+    {0x7c, 0xb8, 0xdc},
+    {0x90, 0xcc, 0xec},
+    {0xa4, 0xe0, 0xfc},
+
+    // a
+    {0x58, 0x00, 0x70},
+    {0x6c, 0x20, 0x88},
+    {0x80, 0x3c, 0xa0},
+    {0x94, 0x58, 0xb4},
+    {0xa4, 0x70, 0xc8},
+    {0xb4, 0x84, 0xdc},
+    {0xc4, 0x9c, 0xec},
+    {0xd4, 0xb0, 0xfc},
+
+    // b
+    {0x00, 0x20, 0x70},
+    {0x1c, 0x3c, 0x88},
+    {0x38, 0x58, 0xa0},
+    {0x50, 0x74, 0xb4},
+    {0x68, 0x88, 0xc8},
+    {0x7c, 0xa0, 0xdc},
+    {0x90, 0xb4, 0xec},
+    {0xa4, 0xc8, 0xfc},
+
+    // c
+    {0x3c, 0x00, 0x80},
+    {0x54, 0x20, 0x94},
+    {0x6c, 0x3c, 0xa8},
+    {0x80, 0x58, 0xbc},
+    {0x94, 0x70, 0xcc},
+    {0xa8, 0x84, 0xdc},
+    {0xb8, 0x9c, 0xec},
+    {0xc8, 0xb0, 0xfc},
+
+    // d
+    {0x00, 0x00, 0x88},
+    {0x20, 0x20, 0x9c},
+    {0x3c, 0x3c, 0xb0},
+    {0x58, 0x58, 0xc0},
+    {0x70, 0x70, 0xd0},
+    {0x84, 0x84, 0xe0},
+    {0x9c, 0x9c, 0xec},
+    {0xb0, 0xb0, 0xfc},
+
+    // e
+    {0x00, 0x00, 0x00},
+    {0x28, 0x28, 0x28},
+    {0x50, 0x50, 0x50},
+    {0x74, 0x74, 0x74},
+    {0x94, 0x94, 0x94},
+    {0xb4, 0xb4, 0xb4},
+    {0xd0, 0xd0, 0xd0},
+    {0xec, 0xec, 0xec},
+
+    // f
+    {0x00, 0x00, 0x00},
+    {0x28, 0x28, 0x28},
+    {0x50, 0x50, 0x50},
+    {0x74, 0x74, 0x74},
+    {0x94, 0x94, 0x94},
+    {0xb4, 0xb4, 0xb4},
+    {0xd0, 0xd0, 0xd0},
+    {0xec, 0xec, 0xec},
+};
+
+// secam sets have a fixed colour for each luminance and ignore the hue
+const char secam_palette[0x08][3] = {
+    {0x00, 0x00, 0x00},
+    {0x21, 0x21, 0xff},
+    {0xf0, 0x3c, 0x79},
+    {0xff, 0x50, 0xff},
+    {0x7f, 0xff, 0x50},
+    {0x7f, 0xff, 0xff},
+    {0xff, 0xff, 0x3f},
+    {0xff, 0xff, 0xff},
+};
+
+const char* const builtin_names[] = {"ntsc", "pal", "secam", "grayscale"};
+
+namespace {
+    std::string selected = "ntsc";
+    char colors[0x80][3];
+
+    // indexed by the value the tia puts out, whose lowest bit is unused,
+    // so the conversion needs no shift
+    std::array<std::uint32_t, palette::argb_size> argb;
+
+    void use_table(const char (*table)[3]) {
+        std::copy(&table[0][0], &table[0][0] + sizeof(colors), &colors[0][0]);
+    }
+
+    void use_secam() {
+        for (unsigned i = 0; i < 0x80; i++) {
+            std::copy(secam_palette[i & 0x07], secam_palette[i & 0x07] + 3,
+                      colors[i]);
+        }
+    }
+
+    void use_grayscale() {
+        for (unsigned i = 0; i < 0x80; i++) {
+            auto rgb = ntsc_palette[i];
+            auto lum = (299 * rgb[0] + 587 * rgb[1] + 114 * rgb[2] + 500) / 1000;
+            colors[i][0] = colors[i][1] = colors[i][2] = char(lum);
+        }
+    }
+
+    // either 128 colours, or 256 of which every other one is used, as
+    // three bytes each
+    bool use_file(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<char> data(std::istreambuf_iterator<char>{file}, {});
+        if (data.size() != 0x80 * 3 && data.size() != 0x100 * 3) {
+            return false;
+        }
+        auto stride = (data.size() == 0x100 * 3) ? 6 : 3;
+        for (unsigned i = 0; i < 0x80; i++) {
+            std::copy(&data[i * stride], &data[i * stride] + 3, colors[i]);
+        }
+        return true;
+    }
+
+    void convert_scalar(std::uint32_t* out, const char* in, unsigned n) {
+        for (unsigned i = 0; i < n; i++) {
+            out[i] = argb[in[i]];
+        }
+    }
+
+#ifdef PALETTE_X86
+    // 128 entries of 32 bits are far too many for byte shuffles, so look
+    // them up with gathers
+    __attribute__((target("avx2")))
+    void convert_avx2(std::uint32_t* out, const char* in, unsigned n) {
+        auto table = reinterpret_cast<const int*>(argb.data());
+        unsigned i = 0;
+        for (; i + 16 <= n; i += 16) {
+            auto idx = _mm_loadu_si128((const __m128i*)(in + i));
+            auto lo = _mm256_cvtepu8_epi32(idx);
+            auto hi = _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8));
+            auto v0 = _mm256_i32gather_epi32(table, lo, 4);
+            auto v1 = _mm256_i32gather_epi32(table, hi, 4);
+            _mm256_storeu_si256((__m256i*)(out + i), v0);
+            _mm256_storeu_si256((__m256i*)(out + i + 8), v1);
+        }
+        convert_scalar(out + i, in + i, n - i);
+    }
+#endif
+
+    void (*convert_row)(std::uint32_t*, const char*, unsigned) = convert_scalar;
+}
+
+// loads the selected palette. a name that is none of the built in ones is
+// taken as a palette file
+bool palette::init() {
+    if (selected == "ntsc") {
+        use_table(ntsc_palette);
+    } else if (selected == "pal") {
+        use_table(pal_palette);
+    } else if (selected == "secam") {
+        use_secam();
+    } else if (selected == "grayscale") {
+        use_grayscale();
+    } else if (use_file(selected) == false) {
+        std::cerr << "could not load palette " << selected << "\n";
+        return false;
+    }
+
+    for (unsigned i = 0; i < argb.size(); i++) {
+        auto rgb = colors[i >> 1];
+        std::uint32_t r = rgb[0];
+        std::uint32_t g = rgb[1];
+        std::uint32_t b = rgb[2];
+        argb[i] = 0xff000000u | (r << 16) | (g << 8) | b;
+    }
+
+    convert_row = convert_scalar;
+#ifdef PALETTE_X86
+    if (__builtin_cpu_supports("avx2")) {
+        convert_row = convert_avx2;
+    }
+#endif
+    return true;
+}
+
+void palette::select(const std::string& name) {
+    selected = name;
+}
+
+// steps through the built in palettes
+void palette::next() {
+    auto count = sizeof(builtin_names) / sizeof(builtin_names[0]);
+    auto it = std::find(builtin_names, builtin_names + count, selected);
+    auto idx = (it == builtin_names + count) ? 0 : it - builtin_names + 1;
+    selected = builtin_names[idx % count];
+    init();
+}
+
+const char (*palette::get())[3] {
+    return colors;
+}
+
+const std::uint32_t* palette::get_argb() {
+    return argb.data();
+}
+
+void palette::convert(const frame::t_buffer& screen, std::uint32_t* out) {
+    convert_row(out, screen.data(), screen.size());
+}
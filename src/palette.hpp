@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "frame.hpp"
+
+// the colours the tia indices stand for, and their conversion to 0xaarrggbb
+namespace palette {
+    // by the value the tia puts out, which is twice the index
+    const unsigned argb_size = 0x100;
+
+    bool init();
+    void select(const std::string&);
+    void next();
+    const char (*get())[3];
+    const std::uint32_t* get_argb();
+    void convert(const frame::t_buffer&, std::uint32_t*);
+}
@@ -1,6 +1,6 @@
 #include "misc.hpp"
 #include "pia.hpp"
-#include "sdl.hpp"
+#include "input.hpp"
 
 class t_timer {
     unsigned interval;
@@ -18,6 +18,11 @@ public:
         return cnt;
     }
 
+    std::uint64_t hash(std::uint64_t h) {
+        h = hash_word(h, interval | std::uint64_t(interval_cnt) << 32);
+        return hash_word(h, std::uint8_t(cnt));
+    }
+
     void cycle() {
         interval_cnt++;
         if (interval_cnt == interval) {
@@ -28,10 +33,35 @@ public:
             cnt--;
         }
     }
+
+    void advance(unsigned long n) {
+        while (n != 0) {
+            if (interval == 1) {
+                cnt -= n;
+                return;
+            }
+            auto left = interval - interval_cnt;
+            if (n < left) {
+                interval_cnt += n;
+                return;
+            }
+            n -= left;
+            interval_cnt = 0;
+            if (cnt == 0) {
+                interval = 1;
+            }
+            cnt--;
+        }
+    }
 };
 
 namespace {
-    t_timer timer;
+    thread_local t_timer timer;
+
+    template <typename t_archive>
+    void transfer(t_archive& ar) {
+        ar(timer);
+    }
 }
 
 void pia::init() {
@@ -66,10 +96,10 @@ char pia::get(t_addr addr) {
 
     case 0x280:
         res = 0xff;
-        set_bit(res, 7, not sdl::get_key(sdl::key_right));
-        set_bit(res, 6, not sdl::get_key(sdl::key_left));
-        set_bit(res, 5, not sdl::get_key(sdl::key_down));
-        set_bit(res, 4, not sdl::get_key(sdl::key_up));
+        set_bit(res, 7, not input::get(input::key_right));
+        set_bit(res, 6, not input::get(input::key_left));
+        set_bit(res, 5, not input::get(input::key_down));
+        set_bit(res, 4, not input::get(input::key_up));
         break;
 
     case 0x284:
@@ -87,3 +117,29 @@ char pia::get(t_addr addr) {
 void pia::cycle() {
     timer.cycle();
 }
+
+void pia::advance(unsigned long n) {
+    timer.advance(n);
+}
+
+std::uint64_t pia::hash_state(std::uint64_t h) {
+    return timer.hash(h);
+}
+
+std::size_t pia::get_state_size() {
+    t_state_size ar;
+    transfer(ar);
+    return ar.get();
+}
+
+char* pia::save_state(char* out) {
+    t_state_saver ar(out);
+    transfer(ar);
+    return ar.get();
+}
+
+const char* pia::load_state(const char* in) {
+    t_state_loader ar(in);
+    transfer(ar);
+    return ar.get();
+}
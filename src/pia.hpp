@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 #include "machine.hpp"
 
 namespace pia {
@@ -7,4 +10,9 @@ namespace pia {
     void set(t_addr, char);
     char get(t_addr);
     void cycle();
+    void advance(unsigned long);
+    std::uint64_t hash_state(std::uint64_t);
+    std::size_t get_state_size();
+    char* save_state(char*);
+    const char* load_state(const char*);
 }
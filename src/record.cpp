@@ -0,0 +1,267 @@
+#include <array>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "record.hpp"
+#include "ring.hpp"
+#include "palette.hpp"
+#include "scale.hpp"
+
+enum t_format {
+    format_y4m,
+    format_ppm,
+    format_rgb,
+    format_index,
+};
+
+namespace {
+    // frames waiting for the writer. when it falls this far behind, frames
+    // are dropped rather than holding up the emulation
+    t_ring<frame::t_buffer, 0x40> frames;
+    std::atomic<bool> active;
+    std::atomic<bool> closing;
+    std::atomic<unsigned long> dropped_cnt;
+    std::thread writer;
+
+    // a write that failed, like a pipe whose reader went away or a full
+    // disk, stops the writer, and the error is told on closing. sigpipe
+    // would kill the emulator, so it is ignored while recording, and the
+    // write fails instead
+    std::atomic<bool> failed;
+    int error;
+    unsigned long written_cnt;
+    void (*old_sigpipe)(int);
+
+    t_format format = format_y4m;
+    bool native = false;
+    std::FILE* file;
+    unsigned fps;
+
+    // the colours at the time the recording was opened, as the bytes of
+    // each plane of the output format
+    std::array<std::array<char, 3>, 0x100> colors;
+
+    // the tia frame the writer works on, and the output frame it is blown up
+    // into, planes one after the other
+    frame::t_buffer screen;
+    unsigned out_width;
+    unsigned out_height;
+    unsigned planes;
+    unsigned pixel_size;
+    std::vector<unsigned> column_map;
+    std::vector<char> out;
+
+    void init_colors() {
+        auto rgb = palette::get();
+        for (unsigned i = 0; i < colors.size(); i++) {
+            int r = rgb[i >> 1][0];
+            int g = rgb[i >> 1][1];
+            int b = rgb[i >> 1][2];
+            if (format == format_y4m) {
+                // bt.601, studio range
+                colors[i][0] = char(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                colors[i][1] = char(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                colors[i][2] = char(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+            } else {
+                colors[i] = {{char(r), char(g), char(b)}};
+            }
+        }
+    }
+
+    bool write_header() {
+        if (format != format_y4m) {
+            return true;
+        }
+        // the scaled frame has square pixels, the native one those of the
+        // window
+        auto aspect = 1000l;
+        if (native) {
+            aspect = std::lround(1000.0 * scale::get_width() * frame::height /
+                                 (scale::get_height() * frame::width));
+        }
+        return std::fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A%ld:1000 "
+                            "C444\n", out_width, out_height, fps, aspect) >= 0;
+    }
+
+    void write_line(char* dst, const char* line, unsigned plane) {
+        for (unsigned x = 0; x < out_width; x++) {
+            auto val = line[column_map[x]];
+            if (format == format_index) {
+                dst[x] = val;
+            } else if (pixel_size == 3) {
+                dst[3 * x + 0] = colors[val][0];
+                dst[3 * x + 1] = colors[val][1];
+                dst[3 * x + 2] = colors[val][2];
+            } else {
+                dst[x] = colors[val][plane];
+            }
+        }
+    }
+
+    bool write_frame() {
+        if (format == format_y4m) {
+            if (std::fputs("FRAME\n", file) == EOF) {
+                return false;
+            }
+        } else if (format == format_ppm) {
+            if (std::fprintf(file, "P6\n%u %u\n255\n", out_width,
+                             out_height) < 0) {
+                return false;
+            }
+        }
+
+        auto line_size = out_width * pixel_size;
+        auto dst = out.data();
+        for (unsigned p = 0; p < planes; p++) {
+            for (unsigned j = 0; j < out_height; j++) {
+                auto src = j * frame::height / out_height;
+                if (j > 0 && src == (j - 1) * frame::height / out_height) {
+                    std::copy(dst - line_size, dst, dst);
+                } else {
+                    write_line(dst, &screen[src * frame::width], p);
+                }
+                dst += line_size;
+            }
+        }
+        return std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    }
+
+    void fail() {
+        error = errno;
+        failed = true;
+    }
+
+    void write_stream() {
+        if (write_header() == false) {
+            fail();
+            return;
+        }
+        while (true) {
+            auto done = closing.load();
+            auto cnt = 0;
+            while (frames.pop(screen)) {
+                if (write_frame() == false) {
+                    fail();
+                    return;
+                }
+                written_cnt++;
+                cnt++;
+            }
+            if (done) {
+                break;
+            }
+            if (cnt == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        if (std::fflush(file) != 0) {
+            fail();
+        }
+    }
+}
+
+bool record::set_format(const std::string& name) {
+    if (name == "y4m") {
+        format = format_y4m;
+    } else if (name == "ppm") {
+        format = format_ppm;
+    } else if (name == "rgb") {
+        format = format_rgb;
+    } else if (name == "index") {
+        format = format_index;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 160x192 instead of the size of the window, without scanlines or filters
+// either way
+void record::set_native(bool val) {
+    native = val;
+}
+
+// "-" is the standard output. the palette has to be loaded before
+bool record::open(const std::string& path, unsigned frames_per_second) {
+    if (path == "-") {
+        file = stdout;
+    } else {
+        file = std::fopen(path.c_str(), "wb");
+    }
+    if (file == nullptr) {
+        std::cerr << "could not open " << path << "\n";
+        return false;
+    }
+
+    fps = (frames_per_second == 0) ? 60 : frames_per_second;
+    out_width = native ? frame::width : scale::get_width();
+    out_height = native ? frame::height : scale::get_height();
+    planes = (format == format_y4m) ? 3 : 1;
+    pixel_size = (format == format_ppm || format == format_rgb) ? 3 : 1;
+    column_map.resize(out_width);
+    for (unsigned x = 0; x < out_width; x++) {
+        column_map[x] = x * frame::width / out_width;
+    }
+    out.resize(out_width * out_height * pixel_size * planes);
+    init_colors();
+
+    dropped_cnt = 0;
+    written_cnt = 0;
+    failed = false;
+    closing = false;
+    old_sigpipe = std::signal(SIGPIPE, SIG_IGN);
+    writer = std::thread(write_stream);
+    active = true;
+    return true;
+}
+
+bool record::is_open() {
+    return active;
+}
+
+// called by the emulation at the end of every frame. nothing is queued once
+// the writer has stopped on an error
+void record::push(const frame::t_buffer& screen) {
+    if (active.load(std::memory_order_relaxed) == false ||
+        failed.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (frames.push(screen) == false) {
+        dropped_cnt++;
+    }
+}
+
+// writes out what is still queued. false if a write failed, or the close
+// that flushes the rest
+bool record::close() {
+    if (active == false) {
+        return true;
+    }
+    active = false;
+    closing = true;
+    writer.join();
+    if (file != stdout && std::fclose(file) != 0 && failed == false) {
+        fail();
+    }
+    file = nullptr;
+    std::signal(SIGPIPE, old_sigpipe);
+    if (dropped_cnt != 0) {
+        std::cerr << "recording dropped " << dropped_cnt << " frames\n";
+    }
+    if (failed) {
+        std::cerr << "recording stopped after " << written_cnt <<
+            " frames : " << std::strerror(error) << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+#include "frame.hpp"
+
+// streams every frame to a file or pipe from a thread of its own
+namespace record {
+    bool set_format(const std::string&);
+    void set_native(bool);
+    bool open(const std::string&, unsigned);
+    bool is_open();
+    void push(const frame::t_buffer&);
+    bool close();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// a fixed size queue between one producer and one consumer thread. neither
+// side ever blocks or allocates; push() fails when the queue is full and
+// pop() when it is empty
+template <class T, std::size_t size>
+class t_ring {
+    static_assert((size & (size - 1)) == 0, "ring size must be a power of 2");
+
+    std::array<T, size> buf;
+    std::atomic<std::size_t> head; // only moved by the producer
+    std::atomic<std::size_t> tail; // only moved by the consumer
+
+public:
+    t_ring() : head(0), tail(0) {
+    }
+
+    bool push(const T& val) {
+        auto h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == size) {
+            return false;
+        }
+        buf[h % size] = val;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& val) {
+        auto t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t) {
+            return false;
+        }
+        val = buf[t % size];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // a snapshot, exact only when called from one of the two sides
+    std::size_t get_count() const {
+        auto t = tail.load(std::memory_order_acquire);
+        return head.load(std::memory_order_acquire) - t;
+    }
+
+    std::size_t get_size() const {
+        return size;
+    }
+};
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rom.hpp"
+
+// the cartridge window, without bank switching all of a cartridge there is
+const auto window_size = std::size_t(0x1000);
+
+namespace {
+    // a power of two mirrors evenly through the window. a larger image
+    // only shows its first 4K
+    bool is_mirrored(std::size_t size) {
+        return size >= window_size || (size != 0 && (size & (size - 1)) == 0);
+    }
+}
+
+t_rom::t_rom() : data(nullptr), mask(0), mapping(nullptr), mapping_size(0) {
+    load(std::vector<char>{});
+}
+
+t_rom::~t_rom() {
+    release();
+}
+
+void t_rom::release() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+    }
+    copy.clear();
+}
+
+bool t_rom::load(const std::string& path) {
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || S_ISREG(st.st_mode) == false) {
+        close(fd);
+        return false;
+    }
+
+    std::size_t size = st.st_size;
+    if (is_mirrored(size) == false) {
+        close(fd);
+        std::ifstream file(path, std::ios::binary);
+        load(std::vector<char>(std::istreambuf_iterator<char>{file}, {}));
+        return true;
+    }
+
+    auto p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    release();
+    mapping = p;
+    mapping_size = size;
+    data = static_cast<const char*>(p);
+    mask = std::min(size, window_size) - 1;
+    return true;
+}
+
+// an image that does not mirror evenly is padded with zeros to the window
+void t_rom::load(const std::vector<char>& image) {
+    release();
+    auto size = std::min(image.size(), window_size);
+    copy.assign(image.begin(), image.begin() + size);
+    if (is_mirrored(size) == false) {
+        copy.resize(window_size, 0x00);
+    }
+    data = copy.data();
+    mask = copy.size() - 1;
+}
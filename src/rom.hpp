@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// a cartridge image. one read from a file is mapped read only, so all the
+// consoles that play it share its pages instead of each holding a copy.
+// the cartridge window is 4K, which a 2K image fills twice
+class t_rom {
+    const char* data;
+    unsigned mask;
+    void* mapping;
+    std::size_t mapping_size;
+    std::vector<char> copy;
+
+    void release();
+
+public:
+    t_rom();
+    ~t_rom();
+    t_rom(const t_rom&) = delete;
+    t_rom& operator=(const t_rom&) = delete;
+
+    bool load(const std::string&);
+    void load(const std::vector<char>&);
+
+    // the byte at an address of the cartridge window is data[addr & mask]
+    const char* get_data() const {
+        return data;
+    }
+    unsigned get_mask() const {
+        return mask;
+    }
+};
@@ -0,0 +1,266 @@
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCALE_X86
+#endif
+
+#include "scale.hpp"
+#include "frame.hpp"
+
+// weights are in 1/128 steps so that a channel times a weight fits in 16 bits
+const auto weight_one = 128u;
+const auto alpha_mask = 0xff000000u;
+
+namespace {
+    // the kernels all work on whole rows of 0xaarrggbb pixels
+
+    // dst = (a * (128 - w) + b * w) / 128 per channel
+    void mix_scalar(std::uint32_t* dst, const std::uint32_t* a,
+                    const std::uint32_t* b, unsigned n, unsigned w) {
+        for (unsigned i = 0; i < n; i++) {
+            std::uint32_t res = alpha_mask;
+            for (unsigned s = 0; s < 24; s += 8) {
+                auto ca = (a[i] >> s) & 0xff;
+                auto cb = (b[i] >> s) & 0xff;
+                res |= ((ca * (weight_one - w) + cb * w) >> 7) << s;
+            }
+            dst[i] = res;
+        }
+    }
+
+    // dst = src * w / 128 per channel
+    void dim_scalar(std::uint32_t* dst, const std::uint32_t* src,
+                    unsigned n, unsigned w) {
+        for (unsigned i = 0; i < n; i++) {
+            std::uint32_t res = alpha_mask;
+            for (unsigned s = 0; s < 24; s += 8) {
+                res |= ((((src[i] >> s) & 0xff) * w) >> 7) << s;
+            }
+            dst[i] = res;
+        }
+    }
+
+    // dst[i] = src[map[i]]
+    void expand_scalar(std::uint32_t* dst, const std::uint32_t* src,
+                       const unsigned* map, unsigned n) {
+        for (unsigned i = 0; i < n; i++) {
+            dst[i] = src[map[i]];
+        }
+    }
+
+#ifdef SCALE_X86
+    __attribute__((target("sse2")))
+    void mix_sse2(std::uint32_t* dst, const std::uint32_t* a,
+                  const std::uint32_t* b, unsigned n, unsigned w) {
+        auto zero = _mm_setzero_si128();
+        auto wa = _mm_set1_epi16(short(weight_one - w));
+        auto wb = _mm_set1_epi16(short(w));
+        auto alpha = _mm_set1_epi32(int(alpha_mask));
+        unsigned i = 0;
+        for (; i + 4 <= n; i += 4) {
+            auto va = _mm_loadu_si128((const __m128i*)(a + i));
+            auto vb = _mm_loadu_si128((const __m128i*)(b + i));
+            auto lo = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+            auto hi = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+            lo = _mm_srli_epi16(lo, 7);
+            hi = _mm_srli_epi16(hi, 7);
+            auto res = _mm_or_si128(_mm_packus_epi16(lo, hi), alpha);
+            _mm_storeu_si128((__m128i*)(dst + i), res);
+        }
+        mix_scalar(dst + i, a + i, b + i, n - i, w);
+    }
+
+    __attribute__((target("sse2")))
+    void dim_sse2(std::uint32_t* dst, const std::uint32_t* src,
+                  unsigned n, unsigned w) {
+        auto zero = _mm_setzero_si128();
+        auto vw = _mm_set1_epi16(short(w));
+        auto alpha = _mm_set1_epi32(int(alpha_mask));
+        unsigned i = 0;
+        for (; i + 4 <= n; i += 4) {
+            auto v = _mm_loadu_si128((const __m128i*)(src + i));
+            auto lo = _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), vw);
+            auto hi = _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), vw);
+            lo = _mm_srli_epi16(lo, 7);
+            hi = _mm_srli_epi16(hi, 7);
+            auto res = _mm_or_si128(_mm_packus_epi16(lo, hi), alpha);
+            _mm_storeu_si128((__m128i*)(dst + i), res);
+        }
+        dim_scalar(dst + i, src + i, n - i, w);
+    }
+
+    __attribute__((target("avx2")))
+    void mix_avx2(std::uint32_t* dst, const std::uint32_t* a,
+                  const std::uint32_t* b, unsigned n, unsigned w) {
+        auto zero = _mm256_setzero_si256();
+        auto wa = _mm256_set1_epi16(short(weight_one - w));
+        auto wb = _mm256_set1_epi16(short(w));
+        auto alpha = _mm256_set1_epi32(int(alpha_mask));
+        unsigned i = 0;
+        for (; i + 8 <= n; i += 8) {
+            auto va = _mm256_loadu_si256((const __m256i*)(a + i));
+            auto vb = _mm256_loadu_si256((const __m256i*)(b + i));
+            auto lo = _mm256_add_epi16(
+                _mm256_mullo_epi16(_mm256_unpacklo_epi8(va, zero), wa),
+                _mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, zero), wb));
+            auto hi = _mm256_add_epi16(
+                _mm256_mullo_epi16(_mm256_unpackhi_epi8(va, zero), wa),
+                _mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, zero), wb));
+            lo = _mm256_srli_epi16(lo, 7);
+            hi = _mm256_srli_epi16(hi, 7);
+            auto res = _mm256_or_si256(_mm256_packus_epi16(lo, hi), alpha);
+            _mm256_storeu_si256((__m256i*)(dst + i), res);
+        }
+        mix_sse2(dst + i, a + i, b + i, n - i, w);
+    }
+
+    __attribute__((target("avx2")))
+    void dim_avx2(std::uint32_t* dst, const std::uint32_t* src,
+                  unsigned n, unsigned w) {
+        auto zero = _mm256_setzero_si256();
+        auto vw = _mm256_set1_epi16(short(w));
+        auto alpha = _mm256_set1_epi32(int(alpha_mask));
+        unsigned i = 0;
+        for (; i + 8 <= n; i += 8) {
+            auto v = _mm256_loadu_si256((const __m256i*)(src + i));
+            auto lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), vw);
+            auto hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), vw);
+            lo = _mm256_srli_epi16(lo, 7);
+            hi = _mm256_srli_epi16(hi, 7);
+            auto res = _mm256_or_si256(_mm256_packus_epi16(lo, hi), alpha);
+            _mm256_storeu_si256((__m256i*)(dst + i), res);
+        }
+        dim_sse2(dst + i, src + i, n - i, w);
+    }
+
+    __attribute__((target("avx2")))
+    void expand_avx2(std::uint32_t* dst, const std::uint32_t* src,
+                     const unsigned* map, unsigned n) {
+        unsigned i = 0;
+        for (; i + 8 <= n; i += 8) {
+            auto idx = _mm256_loadu_si256((const __m256i*)(map + i));
+            auto v = _mm256_i32gather_epi32((const int*)src, idx, 4);
+            _mm256_storeu_si256((__m256i*)(dst + i), v);
+        }
+        expand_scalar(dst + i, src, map + i, n - i);
+    }
+#endif
+
+    void (*mix)(std::uint32_t*, const std::uint32_t*, const std::uint32_t*,
+                unsigned, unsigned) = mix_scalar;
+    void (*dim)(std::uint32_t*, const std::uint32_t*, unsigned, unsigned) =
+        dim_scalar;
+    void (*expand)(std::uint32_t*, const std::uint32_t*, const unsigned*,
+                   unsigned) = expand_scalar;
+
+    unsigned factor = 2;
+    double aspect = 2;
+    unsigned scanlines = 0;
+    unsigned phosphor = 0;
+
+    unsigned out_width;
+    unsigned in_width;
+    std::vector<unsigned> column_map;
+    std::vector<std::uint32_t> persistence;
+
+    // the input is the bare frame or the 4 times wider output of the ntsc
+    // filter, and may change between frames
+    void set_input_width(unsigned width) {
+        in_width = width;
+        for (unsigned x = 0; x < out_width; x++) {
+            column_map[x] = x * in_width / out_width;
+        }
+        persistence.assign(in_width * frame::height, alpha_mask);
+    }
+}
+
+// picks the widest kernels the cpu supports and sizes the buffers. the
+// settings have to be made before
+void scale::init() {
+    mix = mix_scalar;
+    dim = dim_scalar;
+    expand = expand_scalar;
+#ifdef SCALE_X86
+    if (__builtin_cpu_supports("sse2")) {
+        mix = mix_sse2;
+        dim = dim_sse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        mix = mix_avx2;
+        dim = dim_avx2;
+        expand = expand_avx2;
+    }
+#endif
+
+    out_width = get_width();
+    column_map.resize(out_width);
+    set_input_width(frame::width);
+}
+
+void scale::set_factor(unsigned val) {
+    factor = std::max(1u, std::min(max_factor, val));
+}
+
+// the width of a tia pixel relative to the height of a scanline. 2 is the
+// look of the old fixed 640x384 window, 1.6 fills a 4:3 screen
+void scale::set_aspect(double val) {
+    aspect = std::max(0.25, std::min(4.0, val));
+}
+
+// in percent of the brightness taken off the darkened rows
+void scale::set_scanlines(unsigned val) {
+    scanlines = std::min(val, 100u);
+}
+
+// in percent of the previous output kept in the next one
+void scale::set_phosphor(unsigned val) {
+    phosphor = std::min(val, 100u);
+}
+
+unsigned scale::get_width() {
+    return unsigned(std::lround(frame::width * factor * aspect));
+}
+
+unsigned scale::get_height() {
+    return frame::height * factor;
+}
+
+// in is a whole frame of width times frame::height pixels, pitch is counted
+// in pixels
+void scale::run(const std::uint32_t* in, unsigned width, std::uint32_t* out,
+                unsigned pitch) {
+    if (width != in_width) {
+        set_input_width(width);
+    }
+
+    // blending at the source size gives the same picture as blending the
+    // scaled frames, for a fraction of the work
+    if (phosphor != 0) {
+        auto w = phosphor * weight_one / 100;
+        mix(persistence.data(), in, persistence.data(), persistence.size(), w);
+        in = persistence.data();
+    }
+
+    auto dim_weight = weight_one - scanlines * weight_one / 100;
+    auto dark_rows = (scanlines != 0) ? factor / 2 : 0;
+    for (unsigned j = 0; j < frame::height; j++) {
+        auto first = out + j * factor * pitch;
+        expand(first, in + j * in_width, column_map.data(), out_width);
+        for (unsigned r = 1; r < factor; r++) {
+            auto dst = first + r * pitch;
+            if (r >= factor - dark_rows) {
+                dim(dst, first, out_width, dim_weight);
+            } else {
+                std::memcpy(dst, first, out_width * sizeof(std::uint32_t));
+            }
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+// blows the 160x192 frame up to the output size on the cpu, optionally with
+// darkened scanlines and a blend of the previous frames
+namespace scale {
+    const unsigned max_factor = 12;
+
+    void init();
+    void set_factor(unsigned);
+    void set_aspect(double);
+    void set_scanlines(unsigned);
+    void set_phosphor(unsigned);
+    unsigned get_width();
+    unsigned get_height();
+    void run(const std::uint32_t*, unsigned, std::uint32_t*, unsigned);
+}
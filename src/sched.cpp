@@ -0,0 +1,101 @@
+#include "sched.hpp"
+#include "console.hpp"
+#include "frame.hpp"
+#include "rom.hpp"
+
+namespace {
+    // no console is loaded into the thread
+    const auto none = ~0u;
+}
+
+// with summing, every console keeps a verify summary of its own frames
+t_scheduler::t_scheduler(bool val) : loaded(none), summing(val) {
+}
+
+// the console in the thread is saved only once another is about to take
+// its place
+void t_scheduler::unload() {
+    if (loaded != none) {
+        console::save_state(instances[loaded].state.data());
+        loaded = none;
+    }
+}
+
+// a console at power on, which is left loaded. the rom has to stay until
+// the console is removed
+unsigned t_scheduler::add(const t_rom& rom) {
+    unload();
+    unsigned id;
+    if (unused.empty()) {
+        id = instances.size();
+        instances.emplace_back();
+    } else {
+        id = unused.back();
+        unused.pop_back();
+    }
+
+    auto& inst = instances[id];
+    inst.rom = &rom;
+    inst.state.resize(console::get_state_size());
+    inst.summary = verify::t_summary();
+    inst.stats = {0, 0, 0, 0};
+    inst.added = t_clock::now();
+    inst.run_time = queue.empty() ? 0 : queue.begin()->first;
+
+    console::init(rom);
+    loaded = id;
+    queue.insert({inst.run_time, id});
+    return id;
+}
+
+void t_scheduler::remove(unsigned id) {
+    if (loaded == id) {
+        loaded = none;
+    }
+    queue.erase({instances[id].run_time, id});
+    instances[id].rom = nullptr;
+    unused.push_back(id);
+}
+
+std::size_t t_scheduler::get_count() const {
+    return queue.size();
+}
+
+// a frame of the console whose turn it is, which stays loaded so the
+// caller can look at it. false, with id set all the same, if the frame was
+// not finished within the hang limit
+bool t_scheduler::run(unsigned& id) {
+    id = queue.begin()->second;
+    auto& inst = instances[id];
+    queue.erase(queue.begin());
+    if (loaded != id) {
+        unload();
+        console::set_rom(*inst.rom);
+        console::load_state(inst.state.data());
+        loaded = id;
+    }
+
+    verify::set_summary(summing ? &inst.summary : nullptr);
+    auto t0 = t_clock::now();
+    auto ok = console::run_frame();
+    auto t1 = t_clock::now();
+    verify::set_summary(nullptr);
+
+    std::chrono::duration<double> dt = t1 - t0;
+    std::chrono::duration<double> wall = t1 - inst.added;
+    inst.stats.frames = frame::get_count();
+    inst.stats.turns++;
+    inst.stats.seconds += dt.count();
+    inst.stats.wall_seconds = wall.count();
+    inst.run_time += dt.count();
+    queue.insert({inst.run_time, id});
+    return ok;
+}
+
+const t_scheduler::t_stats& t_scheduler::get_stats(unsigned id) const {
+    return instances[id].stats;
+}
+
+const verify::t_summary& t_scheduler::get_summary(unsigned id) const {
+    return instances[id].summary;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <set>
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+#include "verify.hpp"
+
+class t_rom;
+
+// many consoles taking turns on one thread, a frame at a time, so none of
+// them holds the thread for longer than that. the one that has run for the
+// least time goes next. a console waits saved, and is only loaded into the
+// thread for its turn, and not even then when it had the last one. a
+// thread can run a scheduler of its own next to those of other threads
+class t_scheduler {
+public:
+    struct t_stats {
+        long frames;
+        unsigned long turns;
+        // running, and since the console was added
+        double seconds;
+        double wall_seconds;
+    };
+
+private:
+    using t_clock = std::chrono::steady_clock;
+
+    struct t_instance {
+        const t_rom* rom;
+        std::vector<char> state;
+        verify::t_summary summary;
+        t_stats stats;
+        t_clock::time_point added;
+        // the time it has run, counted from where the others were when it
+        // was added, so a new console does not get the thread until it has
+        // caught up with them
+        double run_time;
+    };
+
+    std::vector<t_instance> instances;
+    std::vector<unsigned> unused;
+    std::set<std::pair<double, unsigned>> queue;
+    unsigned loaded;
+    bool summing;
+
+    void unload();
+
+public:
+    explicit t_scheduler(bool);
+
+    unsigned add(const t_rom&);
+    void remove(unsigned);
+    std::size_t get_count() const;
+    bool run(unsigned&);
+    const t_stats& get_stats(unsigned) const;
+    const verify::t_summary& get_summary(unsigned) const;
+};
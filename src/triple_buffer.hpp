@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// hands whole values from one producer thread to one consumer thread without
+// either of them waiting: the producer fills the back slot and swaps it with
+// the middle one, the consumer swaps the middle one with its front slot when
+// it has been refreshed. the consumer only ever sees the newest value
+template <class T>
+class t_triple_buffer {
+    static const unsigned fresh = 4;
+
+    std::array<T, 3> buf;
+    unsigned back;
+    unsigned front;
+    std::atomic<unsigned> middle; // slot index, plus fresh if not yet taken
+
+public:
+    t_triple_buffer() : back(0), front(1), middle(2) {
+    }
+
+    T& get_back() {
+        return buf[back];
+    }
+
+    void publish() {
+        back = middle.exchange(back | fresh) & ~fresh;
+    }
+
+    // the newest value, or nullptr if nothing was published since last time
+    const T* take() {
+        if ((middle.load() & fresh) == 0) {
+            return nullptr;
+        }
+        front = middle.exchange(front) & ~fresh;
+        return &buf[front];
+    }
+};
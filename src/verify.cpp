@@ -0,0 +1,157 @@
+#include <vector>
+#include <cstdio>
+#include <cinttypes>
+#include <iostream>
+
+#include "verify.hpp"
+#include "misc.hpp"
+#include "console.hpp"
+
+namespace {
+    struct t_hashes {
+        std::uint64_t frame;
+        std::uint64_t state;
+    };
+
+    // per emulation thread, like the machine it hashes
+    thread_local std::FILE* output;
+    thread_local bool writing_frames;
+    thread_local std::vector<t_hashes> expected;
+    thread_local bool checking_frames;
+    thread_local bool checking;
+    thread_local long checked_cnt;
+    thread_local bool failed;
+
+    // the summary of the console running on the thread
+    thread_local verify::t_summary* summary;
+
+    void report(long frame, const char* what, std::uint64_t val,
+                std::uint64_t ref) {
+        char buf[0x80];
+        std::snprintf(buf, sizeof(buf), "%016" PRIx64 ", expected %016" PRIx64,
+                      val, ref);
+        std::cerr << "frame " << frame << " diverges : " << what <<
+            " hash " << buf << "\n";
+    }
+}
+
+// one line per frame : its number, the hash of the frame and of the state,
+// or of the state alone. that is about all a frame costs to hash, and leaves
+// a file that still holds for a change in how frames are drawn
+bool verify::open_output(const std::string& path, bool frames) {
+    output = (path == "-") ? stdout : std::fopen(path.c_str(), "w");
+    if (output == nullptr) {
+        std::cerr << "could not open " << path << "\n";
+        return false;
+    }
+    writing_frames = frames;
+    return true;
+}
+
+bool verify::open_expected(const std::string& path) {
+    auto file = std::fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        std::cerr << "could not open " << path << "\n";
+        return false;
+    }
+    expected.clear();
+    char line[0x80];
+    while (std::fgets(line, sizeof(line), file) != nullptr) {
+        long frame;
+        t_hashes val;
+        auto n = std::sscanf(line, "%ld %" SCNx64 " %" SCNx64, &frame,
+                             &val.frame, &val.state);
+        if (n == 2) {
+            val.state = val.frame;
+        } else if (n != 3) {
+            break;
+        }
+        if (expected.empty()) {
+            checking_frames = (n == 3);
+        }
+        if (frame != long(expected.size()) || checking_frames != (n == 3)) {
+            std::cerr << path << " : frame " << frame << " out of order" <<
+                " or of the other format\n";
+            std::fclose(file);
+            return false;
+        }
+        expected.push_back(val);
+    }
+    std::fclose(file);
+    checking = true;
+    checked_cnt = 0;
+    failed = false;
+    return true;
+}
+
+// kept by the caller, which can switch between consoles by switching their
+// summaries. null to stop
+void verify::set_summary(t_summary* val) {
+    summary = val;
+}
+
+// called by the emulation at the end of every frame
+void verify::push(const frame::t_buffer& screen, long frame) {
+    if (output == nullptr && checking == false && summary == nullptr) {
+        return;
+    }
+    auto frames = (summary != nullptr) ||
+        (output != nullptr && writing_frames) || (checking && checking_frames);
+    t_hashes val = {
+        frames ? hash_bytes(hash_seed, screen.data(), screen.size()) : 0,
+        console::hash_state(),
+    };
+    if (summary != nullptr) {
+        summary->frame = val.frame;
+        summary->state = val.state;
+        summary->chain = hash_bytes(summary->chain, &val, sizeof(val));
+    }
+    if (output != nullptr && writing_frames) {
+        std::fprintf(output, "%ld %016" PRIx64 " %016" PRIx64 "\n", frame,
+                     val.frame, val.state);
+    } else if (output != nullptr) {
+        std::fprintf(output, "%ld %016" PRIx64 "\n", frame, val.state);
+    }
+    if (checking && failed == false && frame < long(expected.size())) {
+        auto& ref = expected[frame];
+        if (checking_frames && val.frame != ref.frame) {
+            report(frame, "frame", val.frame, ref.frame);
+            failed = true;
+        } else if (val.state != ref.state) {
+            report(frame, "state", val.state, ref.state);
+            failed = true;
+        } else {
+            checked_cnt++;
+        }
+    }
+}
+
+// the first divergence stops checking, and the run can stop with it
+bool verify::has_failed() {
+    return failed;
+}
+
+// false if the run diverged from the expected hashes or ended before them
+bool verify::close() {
+    summary = nullptr;
+    if (output != nullptr) {
+        if (output != stdout) {
+            std::fclose(output);
+        }
+        output = nullptr;
+    }
+    if (checking == false) {
+        return true;
+    }
+    checking = false;
+    if (failed) {
+        return false;
+    }
+    if (checked_cnt < long(expected.size())) {
+        std::cerr << "only " << checked_cnt << " of " << expected.size() <<
+            " frames were run\n";
+        return false;
+    }
+    std::cerr << checked_cnt << " frames match\n";
+    return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "misc.hpp"
+#include "frame.hpp"
+
+// hashes every frame and the console state at its end, to write them out as
+// golden values or to check a run against such a file. a file may hold the
+// state hashes alone
+namespace verify {
+    // the hashes of the last frame and of all frames so far, of one console
+    struct t_summary {
+        std::uint64_t frame = 0;
+        std::uint64_t state = 0;
+        std::uint64_t chain = hash_seed;
+    };
+
+    bool open_output(const std::string&, bool);
+    bool open_expected(const std::string&);
+    void set_summary(t_summary*);
+    void push(const frame::t_buffer&, long);
+    bool has_failed();
+    bool close();
+}